@@ -0,0 +1,145 @@
+#include <unordered_set>
+#include "graphgen.hpp"
+
+/**
+ *  Adversarial constructions, aimed at the weaknesses of common solutions
+ *  rather than at the problem itself: anti-SPFA weights, labels colliding
+ *  in hash tables, deep DFS recursion and unions that make union-find
+ *  without optimizations quadratic.
+ *
+ *  Each construction is either a builder, which adds the edges to a graph
+ *  with a single bulk insertion, or the labeler or weighter that carries
+ *  the attack. bench_adversarial.cpp measures how much the targeted naive
+ *  algorithm degrades on each of them.
+ */
+
+namespace adversarial {
+    /**
+     *  SpfaGridWeighter weights a grid built with build_grid(rows, cols) so
+     *  that SPFA (Bellman-Ford with a FIFO queue) relaxes each vertex many
+     *  times: the edges inside a row are light and those between two rows
+     *  heavy, so the distances first found going down the columns keep
+     *  being improved by paths that zigzag along the rows.
+     *
+     *  It works best with many more rows than columns (10 to 100 columns)
+     *  and vertex 0 as the source; a RandIntLabeler hides the grid. The
+     *  weights are in [1, light] and [1, heavy], pseudorandom functions of
+     *  the edge and of the seed.
+     */
+    template<typename T>
+    class SpfaGridWeighter: public Weighter<T> {
+    private:
+        size_t cols;
+        T light, heavy;
+        uint64_t seed;
+
+    public:
+        SpfaGridWeighter(
+            const size_t cols,
+            const T light = 10,
+            const T heavy = 1000000,
+            const uint64_t seed = 0
+        ): cols(cols), light(light), heavy(heavy), seed(seed) {}
+        ~SpfaGridWeighter() {}
+
+        T operator()(const edge_t& e) override {
+            vertex_t a = std::min(e.tail, e.head), b = std::max(e.tail, e.head);
+            uint64_t h = utils::mix64(seed ^ (uint64_t(a) << 32 | b));
+            T max = b - a < cols ? light : heavy;
+            return T(h % uint64_t(max)) + 1;
+        }
+
+        bool is_thread_safe() const override {
+            return true;
+        }
+    };
+
+    /**
+     *  Returns the number of buckets of a std::unordered_set of integers
+     *  after inserting n of them one at a time. Solutions compiled with the
+     *  same standard library as the generator (e.g. libstdc++ for GCC) go
+     *  through the same sizes when they insert n keys.
+     */
+    size_t bucket_count(const size_t n) {
+        std::unordered_set<uint64_t> set;
+        for (size_t i = 0; i < n; i++)
+            set.insert(i);
+        return set.bucket_count();
+    }
+
+    /**
+     *  CollidingLabeler gives labels that fall in few buckets of a hash
+     *  table with the given number of buckets, such as bucket_count(N),
+     *  when hashed by std::hash, which is the identity on integers. The
+     *  labels are 1 plus the multiples of buckets not greater than
+     *  max_label, then 2 plus them, and so on, so each occupied bucket
+     *  holds per = max_label / buckets of them and a table with all the
+     *  vertices does about N * per comparisons instead of N.
+     */
+    template<typename T = int64_t>
+    class CollidingLabeler: public Labeler<T> {
+    private:
+        uint64_t buckets, per;
+
+    public:
+        CollidingLabeler(
+            const size_t vertices_no,
+            const uint64_t buckets,
+            const T max_label = std::numeric_limits<T>::max()
+        ): buckets(buckets), per(uint64_t(max_label) / buckets) {
+            if (per == 0 || (vertices_no + per - 1) / per > buckets)
+                throw TooManyNodesException();
+        }
+        ~CollidingLabeler() {}
+
+        T operator()(const vertex_t i) override {
+            return T(i % per * buckets + i / per + 1);
+        }
+
+        bool is_thread_safe() const override {
+            return true;
+        }
+    };
+
+    /**
+     *  Builds a caterpillar: a path through the vertices 0, 1, ..., spine-1,
+     *  with each of the other vertices attached to a random vertex of the
+     *  path. Whatever the root and the order of the edges, a DFS on it
+     *  reaches depth at least spine/2, which overflows the stack of a
+     *  recursive DFS long before a random tree does. In directed graphs
+     *  the edges point away from vertex 0.
+     */
+    template<typename G>
+    void build_caterpillar(G& g, const size_t spine) {
+        const size_t vertices_no = g.get_vertices_no();
+        if (spine == 0 || spine > vertices_no)
+            throw TooManyNodesException();
+        std::vector<edge_t> edges;
+        edges.reserve(vertices_no - 1);
+        for (vertex_t v = 1; v < spine; v++)
+            edges.push_back({v - 1, v});
+        for (vertex_t v = spine; v < vertices_no; v++)
+            edges.push_back({Random::randrange(vertex_t(0), vertex_t(spine)), v});
+        g.add_edge_list(std::move(edges));
+    }
+
+    /**
+     *  Builds a star centered in vertex 0, and returns its edges in the
+     *  order that makes union-find without union by rank or size quadratic.
+     *  For solutions that do union(a, b) by linking find(a) under find(b)
+     *  (link_tail) the edges are (0, 1), (0, 2), ..., (0, N-1), so the
+     *  leaves form a chain below 0 which each union walks from the start;
+     *  otherwise they are (1, 0), (2, 0), and so on. Write the graph with
+     *  write_in_order.
+     */
+    template<typename G>
+    std::vector<edge_t> build_union_find_star(G& g, const bool link_tail = true) {
+        const size_t vertices_no = g.get_vertices_no();
+        std::vector<edge_t> edges;
+        edges.reserve(vertices_no);
+        for (vertex_t v = 1; v < vertices_no; v++)
+            edges.push_back(link_tail ? edge_t{0, v} : edge_t{v, 0});
+        g.add_edge_list(edges);
+        return edges;
+    }
+}
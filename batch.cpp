@@ -0,0 +1,50 @@
+// Generates all the test cases listed in a manifest (see batch.hpp).
+//
+// Usage: batch <manifest> [threads]
+//
+// Build with: g++ -std=c++11 -O2 -pthread batch.cpp -o batch
+// (add -DGRAPHGEN_USE_ZLIB -lz to support .gz outputs)
+
+#include <cstdlib>
+#include <iomanip>
+#include "batch.hpp"
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " <manifest> [threads]" << std::endl;
+        return 2;
+    }
+    std::ifstream manifest(argv[1]);
+    if (!manifest) {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        return 2;
+    }
+    size_t threads_no = argc == 3 ? std::atoi(argv[2]) : utils::threads_no();
+
+    std::vector<batch::Case> cases;
+    try {
+        cases = batch::parse_manifest(manifest);
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<batch::Result> results = batch::run_batch(cases, threads_no);
+    auto end = std::chrono::steady_clock::now();
+
+    bool failed = false;
+    std::cout << std::fixed << std::setprecision(3);
+    for (const batch::Result& r: results) {
+        std::cout << std::setw(10) << r.seconds << "s  " << r.output;
+        if (!r.error.empty()) {
+            std::cout << "  FAILED: " << r.error;
+            failed = true;
+        }
+        std::cout << std::endl;
+    }
+    std::cout << std::setw(10) << std::chrono::duration<double>(end - start).count()
+              << "s  total (" << cases.size() << " cases, "
+              << threads_no << " threads)" << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,452 @@
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <stdexcept>
+#include "graphgen.hpp"
+
+/**
+ *  Batch generation of test cases.
+ *
+ *  A manifest lists the cases to generate, one per line:
+ *
+ *      <output> <seed> <undirected|directed> <vertices> <operation>...
+ *
+ *  Each operation is a name, optionally followed by a colon and a comma
+ *  separated list of numeric arguments, and corresponds to a method of the
+ *  graph: for example "tree add_edges:5000 connect" or "regular:3,1000".
+ *  Empty lines and lines starting with # are ignored. The graph is written
+ *  to the output file, compressed with gzip if its name ends with .gz.
+ */
+
+class ManifestException: public std::exception {
+private:
+    std::string message;
+
+public:
+    ManifestException(const size_t line, const std::string& error) {
+        std::ostringstream os;
+        os << "Manifest line " << line << ": " << error;
+        message = os.str();
+    }
+
+    virtual const char* what() const noexcept {
+        return message.c_str();
+    }
+};
+
+namespace batch {
+    struct Operation {
+        std::string name;
+        std::vector<double> args;
+    };
+
+    struct Case {
+        std::string output;
+        uint64_t seed;
+        bool directed;
+        size_t vertices_no;
+        std::vector<Operation> operations;
+        // Line of the manifest, used in error messages
+        size_t line;
+
+        /**
+         *  A rough estimate of the size of the generated graph, used to
+         *  decide which cases are worth splitting in parallel sub-tasks.
+         */
+        size_t weight() const {
+            size_t res = vertices_no;
+            for (const Operation& op: operations) {
+                for (double a: op.args)
+                    res += a > 0 && a < 1e18 ? size_t(a) : 0;
+                if (op.name == "clique")
+                    res += vertices_no * (vertices_no - 1) / 2;
+            }
+            return res;
+        }
+    };
+
+    struct Result {
+        std::string output;
+        double seconds;
+        // Empty if the case was generated successfully
+        std::string error;
+    };
+
+    /**
+     *  Reads a manifest. Throws ManifestException if it is malformed.
+     */
+    std::vector<Case> parse_manifest(std::istream& is) {
+        std::vector<Case> cases;
+        std::string text;
+        for (size_t line = 1; std::getline(is, text); line++) {
+            std::istringstream ls(text);
+            Case c;
+            c.line = line;
+            std::string kind;
+            if (!(ls >> c.output) || c.output[0] == '#')
+                continue;
+            if (!(ls >> c.seed >> kind >> c.vertices_no))
+                throw ManifestException(line, "expected <output> <seed> <kind> <vertices>");
+            if (kind != "undirected" && kind != "directed")
+                throw ManifestException(line, "unknown graph kind " + kind);
+            c.directed = kind == "directed";
+
+            std::string token;
+            while (ls >> token) {
+                Operation op;
+                size_t colon = token.find(':');
+                op.name = token.substr(0, colon);
+                if (colon != std::string::npos) {
+                    std::istringstream as(token.substr(colon + 1));
+                    std::string arg;
+                    while (std::getline(as, arg, ',')) {
+                        std::istringstream vs(arg);
+                        double v;
+                        if (!(vs >> v) || !vs.eof())
+                            throw ManifestException(line, "bad argument in " + token);
+                        op.args.push_back(v);
+                    }
+                }
+                c.operations.push_back(op);
+            }
+            cases.push_back(c);
+        }
+        return cases;
+    }
+
+    /**
+     *  Applies the operations that both kinds of graphs support. Returns
+     *  false if the operation is unknown.
+     */
+    template<typename G>
+    bool apply_common(G& g, const Operation& op) {
+        const std::vector<double>& a = op.args;
+        auto arg = [&](size_t i) -> size_t {
+            if (i >= a.size())
+                throw std::invalid_argument(op.name + " needs more arguments");
+            return a[i];
+        };
+        if (op.name == "add_edges") g.add_edges(arg(0));
+        else if (op.name == "connect") g.connect();
+        else if (op.name == "forest") g.build_forest(arg(0));
+        else if (op.name == "tree") g.build_tree();
+        else if (op.name == "path") g.build_path();
+        else if (op.name == "cycle") g.build_cycle();
+        else if (op.name == "star") g.build_star();
+        else if (op.name == "wheel") g.build_wheel();
+        else if (op.name == "clique") g.build_clique();
+        else if (op.name == "grid") g.build_grid(arg(0), arg(1));
+        else if (op.name == "geometric") {
+            if (a.empty())
+                throw std::invalid_argument("geometric needs the radius");
+            g.build_geometric(a[0]);
+        }
+        else if (op.name == "sample_edges") g.sample_edges(arg(0));
+        else return false;
+        return true;
+    }
+
+    void apply(UndirectedGraph<int>& g, const Operation& op) {
+        if (apply_common(g, op)) return;
+        if (op.name == "spanning_tree") {
+            g.random_spanning_tree();
+            return;
+        }
+        if (op.name == "regular") {
+            if (op.args.empty())
+                throw std::invalid_argument("regular needs the degree");
+            g.build_regular(op.args[0], op.args.size() > 1 ? op.args[1] : 0);
+            return;
+        }
+        throw std::invalid_argument("unknown operation " + op.name);
+    }
+
+    void apply(DirectedGraph<int>& g, const Operation& op) {
+        if (apply_common(g, op)) return;
+        if (op.name == "dag") {
+            if (op.args.empty())
+                throw std::invalid_argument("dag needs the number of edges");
+            g.build_dag(op.args[0]);
+            return;
+        }
+        if (op.name == "layered_dag") {
+            const std::vector<double>& a = op.args;
+            if (a.size() < 2)
+                throw std::invalid_argument("layered_dag needs the layers and the number of edges");
+            g.build_layered_dag(a[0], a[1], a.size() > 2 ? a[2] : 1, a.size() > 3 && a[3] != 0);
+            return;
+        }
+        throw std::invalid_argument("unknown operation " + op.name);
+    }
+
+    template<typename G>
+    void generate(const Case& c, std::ostream& os) {
+        IotaLabeler labeler;
+        NoWeighter weighter;
+        G g(c.vertices_no, labeler, weighter);
+        for (const Operation& op: c.operations)
+            apply(g, op);
+        g.write(os);
+    }
+
+    /**
+     *  Generates a case and writes it to its output file
+     */
+    void run_case(const Case& c) {
+        std::ofstream file(c.output, std::ios::binary);
+        if (!file)
+            throw IOException();
+        Random::seed(c.seed);
+        auto write = [&](std::ostream& os) {
+            if (c.directed)
+                generate<DirectedGraph<int>>(c, os);
+            else
+                generate<UndirectedGraph<int>>(c, os);
+        };
+#ifdef GRAPHGEN_USE_ZLIB
+        const std::string& name = c.output;
+        if (name.size() >= 3 && name.substr(name.size() - 3) == ".gz") {
+            GzipStreambuf buf(file);
+            std::ostream os(&buf);
+            write(os);
+            buf.close();
+        } else {
+            write(file);
+        }
+#else
+        write(file);
+#endif
+        file.close();
+        if (!file)
+            throw IOException();
+    }
+
+    /**
+     *  A thread pool with one queue of tasks per worker. Workers take the
+     *  newest task from their own queue, and when it is empty they steal the
+     *  oldest task of another worker. The pool is the executor of its
+     *  workers, so the parallel algorithms of the library that run on them
+     *  split their work in tasks of the pool as well.
+     */
+    class WorkStealingPool: public utils::Executor {
+    private:
+        struct Queue {
+            std::deque<std::function<void()>> tasks;
+            std::mutex mutex;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+        // Number of tasks in the queues, and of submitted tasks not done yet
+        std::atomic<size_t> queued, pending;
+        std::atomic<size_t> next_queue;
+        bool stopping;
+        std::mutex idle_mutex;
+        std::condition_variable idle_cv, done_cv;
+
+        // The queue of the calling thread, or -1 if it is not a worker
+        static int& current_queue() {
+            static thread_local int index = -1;
+            return index;
+        }
+
+        bool pop(std::function<void()>& task) {
+            int own = current_queue();
+            if (own >= 0) {
+                Queue& q = *queues[own];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if (!q.tasks.empty()) {
+                    task = std::move(q.tasks.back());
+                    q.tasks.pop_back();
+                    queued--;
+                    return true;
+                }
+            }
+            size_t start = own >= 0 ? own + 1 : 0;
+            for (size_t i = 0; i < queues.size(); i++) {
+                Queue& q = *queues[(start + i) % queues.size()];
+                std::lock_guard<std::mutex> lock(q.mutex);
+                if (!q.tasks.empty()) {
+                    task = std::move(q.tasks.front());
+                    q.tasks.pop_front();
+                    queued--;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         *  Runs one of the queued tasks, if there is any
+         */
+        bool run_one() {
+            std::function<void()> task;
+            if (!pop(task))
+                return false;
+            task();
+            if (--pending == 0) {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                done_cv.notify_all();
+            }
+            return true;
+        }
+
+        void work(const int index) {
+            current_queue() = index;
+            utils::executor = this;
+            while (true) {
+                if (run_one())
+                    continue;
+                std::unique_lock<std::mutex> lock(idle_mutex);
+                idle_cv.wait(lock, [&]() { return stopping || queued > 0; });
+                if (stopping && queued == 0)
+                    return;
+            }
+        }
+
+    public:
+        explicit WorkStealingPool(const size_t threads_no):
+            queued(0), pending(0), next_queue(0), stopping(false) {
+            for (size_t i = 0; i < threads_no; i++)
+                queues.emplace_back(new Queue());
+            for (size_t i = 0; i < threads_no; i++)
+                threads.emplace_back(&WorkStealingPool::work, this, int(i));
+        }
+
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        ~WorkStealingPool() {
+            {
+                std::lock_guard<std::mutex> lock(idle_mutex);
+                stopping = true;
+            }
+            idle_cv.notify_all();
+            for (auto& t: threads)
+                t.join();
+        }
+
+        size_t size() const {
+            return threads.size();
+        }
+
+        /**
+         *  Adds a task to the queue of the calling worker, or to the queues
+         *  in turn if called from another thread. The task must not throw.
+         */
+        void submit(std::function<void()> task) {
+            int own = current_queue();
+            size_t index = own >= 0 ? own : next_queue++ % queues.size();
+            pending++;
+            {
+                std::lock_guard<std::mutex> lock(queues[index]->mutex);
+                queues[index]->tasks.push_back(std::move(task));
+                queued++;
+            }
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            idle_cv.notify_one();
+        }
+
+        /**
+         *  Waits until all the submitted tasks are done
+         */
+        void wait() {
+            std::unique_lock<std::mutex> lock(idle_mutex);
+            done_cv.wait(lock, [&]() { return pending == 0; });
+        }
+
+        /**
+         *  Submits the tasks and runs them until they are all done, so that
+         *  a worker waiting for its sub-tasks keeps being useful. The
+         *  sub-tasks wait in a queue of their own, and the caller only runs
+         *  those: another task, such as a whole case of a batch, would
+         *  reseed its generator and change its max_threads. Other workers
+         *  that help run the sub-tasks with the max_threads of the caller.
+         */
+        void run_all(std::vector<std::function<void()>>& tasks) override {
+            struct Batch {
+                std::deque<std::function<void()>> tasks;
+                std::mutex mutex;
+                std::atomic<size_t> remaining;
+                std::exception_ptr error;
+                size_t max_threads;
+            };
+            std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+            batch->tasks.assign(tasks.begin(), tasks.end());
+            batch->remaining = tasks.size();
+            batch->max_threads = utils::max_threads;
+            // Runs one of the sub-tasks, if there is any left
+            auto run_next = [](Batch& b) {
+                std::function<void()> task;
+                {
+                    std::lock_guard<std::mutex> lock(b.mutex);
+                    if (b.tasks.empty()) return false;
+                    task = std::move(b.tasks.front());
+                    b.tasks.pop_front();
+                }
+                try {
+                    task();
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(b.mutex);
+                    if (!b.error) b.error = std::current_exception();
+                }
+                b.remaining--;
+                return true;
+            };
+            for (size_t i = 0; i < tasks.size(); i++) {
+                submit([batch, run_next]() {
+                    const size_t max_threads = utils::max_threads;
+                    utils::max_threads = batch->max_threads;
+                    run_next(*batch);
+                    utils::max_threads = max_threads;
+                });
+            }
+            while (batch->remaining > 0)
+                if (!run_next(*batch))
+                    std::this_thread::yield();
+            if (batch->error)
+                std::rethrow_exception(batch->error);
+        }
+    };
+
+    /**
+     *  Generates all the cases on a work-stealing pool with threads_no
+     *  threads, and returns the time spent on each of them. Cases whose
+     *  weight is at least large_case are allowed to use the whole pool for
+     *  their parallel algorithms; the others run on a single thread.
+     *  The errors are reported in the results instead of being thrown.
+     */
+    std::vector<Result> run_batch(
+        const std::vector<Case>& cases,
+        const size_t threads_no,
+        const size_t large_case = 1 << 22
+    ) {
+        std::vector<Result> results(cases.size());
+        WorkStealingPool pool(std::max<size_t>(1, threads_no));
+        // Start from the heaviest cases, so that they do not end up last
+        std::vector<size_t> order(cases.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return cases[a].weight() > cases[b].weight();
+        });
+        for (size_t i: order) {
+            pool.submit([&, i]() {
+                const Case& c = cases[i];
+                Result& r = results[i];
+                r.output = c.output;
+                utils::max_threads = c.weight() >= large_case ? pool.size() : 1;
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    run_case(c);
+                } catch (std::exception& e) {
+                    r.error = e.what();
+                }
+                auto end = std::chrono::steady_clock::now();
+                r.seconds = std::chrono::duration<double>(end - start).count();
+            });
+        }
+        pool.wait();
+        return results;
+    }
+}
+
@@ -0,0 +1,210 @@
+// Runs the naive algorithms targeted by the constructions in adversarial.hpp
+// on them and on random graphs of the same size, and prints how much more
+// work they do on the adversarial ones. The graphs are written and parsed
+// back, so the algorithms see the edges in the order a solution would.
+//
+// Usage: bench_adversarial [vertices] [seed]
+//
+// Build with: g++ -std=c++11 -O2 -pthread bench_adversarial.cpp -o bench_adversarial
+
+#include <cstdlib>
+#include <iomanip>
+#include <unordered_map>
+#include "adversarial.hpp"
+
+struct Input {
+    size_t vertices_no;
+    std::vector<int64_t> tails, heads, weights;
+};
+
+Input parse(const std::string& text, const bool weighted) {
+    std::istringstream is(text);
+    Input in;
+    size_t edges_no;
+    is >> in.vertices_no >> edges_no;
+    in.tails.resize(edges_no);
+    in.heads.resize(edges_no);
+    in.weights.resize(weighted ? edges_no : 0);
+    for (size_t i = 0; i < edges_no; i++) {
+        is >> in.tails[i] >> in.heads[i];
+        if (weighted)
+            is >> in.weights[i];
+    }
+    return in;
+}
+
+typedef std::vector<std::vector<std::pair<size_t, int64_t>>> adjacency_t;
+
+// The labels must go from 0 to N-1
+adjacency_t adjacency(const Input& in) {
+    adjacency_t adj(in.vertices_no);
+    for (size_t i = 0; i < in.tails.size(); i++) {
+        int64_t w = in.weights.empty() ? 1 : in.weights[i];
+        adj[in.tails[i]].push_back({size_t(in.heads[i]), w});
+        adj[in.heads[i]].push_back({size_t(in.tails[i]), w});
+    }
+    return adj;
+}
+
+// Returns the number of relaxations
+uint64_t spfa(const adjacency_t& adj, const size_t source) {
+    std::vector<int64_t> dist(adj.size(), std::numeric_limits<int64_t>::max());
+    std::vector<bool> queued(adj.size(), false);
+    std::deque<size_t> queue = {source};
+    dist[source] = 0;
+    queued[source] = true;
+    uint64_t relaxations = 0;
+    while (!queue.empty()) {
+        size_t v = queue.front();
+        queue.pop_front();
+        queued[v] = false;
+        for (auto& e: adj[v]) {
+            if (dist[v] + e.second >= dist[e.first]) continue;
+            dist[e.first] = dist[v] + e.second;
+            relaxations++;
+            if (!queued[e.first]) {
+                queued[e.first] = true;
+                queue.push_back(e.first);
+            }
+        }
+    }
+    return relaxations;
+}
+
+// Maps the labels to indices in order of appearance, as solutions with
+// arbitrary labels do, and returns the size of the largest bucket
+uint64_t hash_labels(const Input& in) {
+    std::unordered_map<int64_t, size_t> index;
+    for (size_t i = 0; i < in.tails.size(); i++) {
+        index.insert({in.tails[i], index.size()});
+        index.insert({in.heads[i], index.size()});
+    }
+    size_t largest = 0;
+    for (size_t b = 0; b < index.bucket_count(); b++)
+        largest = std::max(largest, index.bucket_size(b));
+    return largest;
+}
+
+// Returns the maximum depth reached by a recursive DFS
+uint64_t dfs_depth(const adjacency_t& adj, const size_t root) {
+    std::vector<bool> visited(adj.size(), false);
+    std::vector<std::pair<size_t, size_t>> stack = {{root, 0}};
+    visited[root] = true;
+    uint64_t depth = 0;
+    while (!stack.empty()) {
+        depth = std::max<uint64_t>(depth, stack.size());
+        auto& top = stack.back();
+        if (top.second == adj[top.first].size()) {
+            stack.pop_back();
+            continue;
+        }
+        size_t next = adj[top.first][top.second++].first;
+        if (!visited[next]) {
+            visited[next] = true;
+            stack.push_back({next, 0});
+        }
+    }
+    return depth;
+}
+
+// Union-find without union by rank nor path compression, where union(a, b)
+// links find(a) under find(b). Returns the number of parent links followed.
+uint64_t naive_union_find(const Input& in) {
+    std::vector<size_t> parent(in.vertices_no);
+    std::iota(parent.begin(), parent.end(), 0);
+    uint64_t steps = 0;
+    auto find = [&](size_t v) {
+        while (parent[v] != v) {
+            v = parent[v];
+            steps++;
+        }
+        return v;
+    };
+    for (size_t i = 0; i < in.tails.size(); i++)
+        parent[find(in.tails[i])] = find(in.heads[i]);
+    return steps;
+}
+
+template<typename Run>
+void report(const std::string& name, Run run, const Input& random, const Input& adversarial) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t r = run(random);
+    auto middle = std::chrono::steady_clock::now();
+    uint64_t a = run(adversarial);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << std::left << std::setw(26) << name << std::right
+              << std::setw(14) << r << std::setw(9)
+              << std::chrono::duration<double>(middle - start).count() << "s"
+              << std::setw(14) << a << std::setw(9)
+              << std::chrono::duration<double>(end - middle).count() << "s"
+              << std::setw(11) << double(a) / std::max<uint64_t>(r, 1) << "x"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 3) {
+        std::cerr << "Usage: " << argv[0] << " [vertices] [seed]" << std::endl;
+        return 2;
+    }
+    const size_t n = argc > 1 ? std::atoll(argv[1]) : 20000;
+    Random::seed(argc > 2 ? std::atoll(argv[2]) : 42);
+    const size_t cols = 10, rows = n / cols;
+    const int heavy = 1000000;
+
+    std::cout << std::fixed << std::setprecision(3)
+              << std::left << std::setw(26) << "algorithm (work)" << std::right
+              << std::setw(24) << "random" << std::setw(24) << "adversarial"
+              << std::setw(12) << "ratio" << std::endl;
+
+    {
+        // A random connected graph with as many edges as the grid
+        RandIntLabeler labeler(0, rows * cols);
+        RandomWeighter<int> weighter(1, heavy);
+        UndirectedGraph<int, int> random(rows * cols, labeler, weighter);
+        random.build_tree();
+        random.add_edges(rows * (cols - 1) + (rows - 1) * cols - (rows * cols - 1));
+        adversarial::SpfaGridWeighter<int> grid_weighter(cols, 10, heavy, 42);
+        UndirectedGraph<int, int> grid(rows * cols, labeler, grid_weighter);
+        grid.build_grid(rows, cols);
+        report("SPFA (relaxations)", [&](const Input& in) {
+            return spfa(adjacency(in), labeler(0));
+        }, parse(random.to_string(), true), parse(grid.to_string(), true));
+    }
+    {
+        RandIntLabeler random_labeler(0, n);
+        NoWeighter weighter;
+        UndirectedGraph<int, void> random(n, random_labeler, weighter);
+        random.build_tree();
+        adversarial::CollidingLabeler<int64_t> labeler(
+            n, adversarial::bucket_count(n), 1000000000000000000LL
+        );
+        UndirectedGraph<int64_t, void> colliding(n, labeler, weighter);
+        colliding.build_tree();
+        report("hash map (largest bucket)", hash_labels,
+               parse(random.to_string(), false), parse(colliding.to_string(), false));
+    }
+    {
+        RandIntLabeler labeler(0, n);
+        NoWeighter weighter;
+        UndirectedGraph<int, void> random(n, labeler, weighter);
+        random.build_tree();
+        UndirectedGraph<int, void> caterpillar(n, labeler, weighter);
+        adversarial::build_caterpillar(caterpillar, n / 2);
+        report("DFS (recursion depth)", [&](const Input& in) {
+            return dfs_depth(adjacency(in), labeler(0));
+        }, parse(random.to_string(), false), parse(caterpillar.to_string(), false));
+    }
+    {
+        RandIntLabeler labeler(0, n);
+        NoWeighter weighter;
+        UndirectedGraph<int, void> random(n, labeler, weighter);
+        random.build_tree();
+        UndirectedGraph<int, void> star(n, labeler, weighter);
+        std::vector<edge_t> order = adversarial::build_union_find_star(star);
+        std::ostringstream os;
+        star.write_in_order(os, order);
+        report("union-find (links)", naive_union_find,
+               parse(random.to_string(), false), parse(os.str(), false));
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Prints the fingerprints of graph files written by the library, in the
+// "N M / tail head [weight]" format, and lists the files that are the same
+// graph, to find duplicate test cases.
+//
+// Usage: fingerprint [--directed] [--invariant] [--base B] [--threads T] <file or directory>...
+//
+// The fingerprint does not depend on the order of the edges, nor on the
+// orientation of the undirected ones (see fingerprints in graphgen.hpp).
+// With --invariant it does not depend on the labels either, so isomorphic
+// graphs have the same one. The labels go from B (default 0) to B + N - 1.
+// The files of a directory are fingerprinted in parallel.
+//
+// Build with: g++ -std=c++11 -O2 -pthread fingerprint.cpp -o fingerprint
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <dirent.h>
+#include "batch.hpp"
+
+struct edge_record {
+    uint64_t key, weight;
+};
+
+fingerprints::value_t fingerprint_file(
+    const std::string& path,
+    const bool directed,
+    const bool invariant,
+    const int64_t base
+) {
+    utils::MappedFile file(path);
+    const char* end = file.data() + file.size();
+    size_t vertices_no;
+    std::vector<edge_record> records = utils::parse_edges<edge_record>(
+        file.data(), file.size(), base, vertices_no,
+        [directed, end](vertex_t tail, vertex_t head, const char* rest,
+                        std::vector<edge_record>& out) {
+            // Undirected edges are stored with tail >= head
+            if (!directed && tail < head)
+                std::swap(tail, head);
+            while (rest < end && (*rest == ' ' || *rest == '\t')) rest++;
+            const char* stop = rest;
+            while (stop < end && !isspace(*stop)) stop++;
+            uint64_t weight = stop == rest ? 0 : utils::hash_text(rest, stop - rest);
+            out.push_back({verifier::pack(tail, head), weight});
+        }
+    );
+    std::vector<uint64_t> keys(records.size()), weights;
+    bool weighted = false;
+    for (size_t i = 0; i < records.size(); i++) {
+        keys[i] = records[i].key;
+        weighted |= records[i].weight != 0;
+    }
+    if (weighted) {
+        weights.resize(records.size());
+        for (size_t i = 0; i < records.size(); i++)
+            weights[i] = records[i].weight;
+    }
+    if (invariant)
+        return fingerprints::invariant(vertices_no, keys, weights, directed);
+    return fingerprints::of_edges(vertices_no, keys, weights, directed);
+}
+
+// Appends the regular files in path, in name order, or path itself
+void list_files(const std::string& path, std::vector<std::string>& files) {
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        files.push_back(path);
+        return;
+    }
+    std::vector<std::string> names;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        struct stat st;
+        if (stat((path + "/" + name).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+            names.push_back(path + "/" + name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    files.insert(files.end(), names.begin(), names.end());
+}
+
+int main(int argc, char** argv) {
+    bool directed = false, invariant = false;
+    int64_t base = 0;
+    size_t threads_no = utils::threads_no();
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--directed"))
+            directed = true;
+        else if (!strcmp(argv[i], "--invariant"))
+            invariant = true;
+        else if (!strcmp(argv[i], "--base") && i + 1 < argc)
+            base = std::atoll(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+            threads_no = std::atoi(argv[++i]);
+        else
+            list_files(argv[i], files);
+    }
+    if (files.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--directed] [--invariant] [--base B]"
+                  << " [--threads T] <file or directory>..." << std::endl;
+        return 2;
+    }
+
+    std::vector<fingerprints::value_t> values(files.size());
+    std::vector<std::string> errors(files.size());
+    {
+        // Each file is parsed and hashed by one thread of the pool, whose
+        // other threads help with the large ones
+        batch::WorkStealingPool pool(std::max<size_t>(1, threads_no));
+        for (size_t i = 0; i < files.size(); i++) {
+            pool.submit([&, i]() {
+                utils::max_threads = pool.size();
+                try {
+                    values[i] = fingerprint_file(files[i], directed, invariant, base);
+                } catch (std::exception& e) {
+                    errors[i] = e.what();
+                }
+            });
+        }
+        pool.wait();
+    }
+
+    bool failed = false;
+    std::map<fingerprints::value_t, std::vector<std::string>> groups;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!errors[i].empty()) {
+            std::cout << files[i] << ": " << errors[i] << std::endl;
+            failed = true;
+            continue;
+        }
+        std::cout << values[i].to_string() << "  " << files[i] << std::endl;
+        groups[values[i]].push_back(files[i]);
+    }
+    for (auto& g: groups) {
+        if (g.second.size() < 2) continue;
+        std::cout << "same graph:";
+        for (const std::string& f: g.second)
+            std::cout << " " << f;
+        std::cout << std::endl;
+    }
+    return failed ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include "Python.h"
+#include <fstream>
 #include "graphgen.hpp"
 
 #define CATCH(ret) \
@@ -13,6 +14,7 @@
 #define METHOD_VOIDVOID(obj, name) \
     static PyObject* obj ## _ ## name(obj ## Obj* self) { \
         try { \
+            GraphLock lock(self->state); \
             self->g->name(); \
         } CATCH(NULL) \
         Py_RETURN_NONE; \
@@ -28,11 +30,326 @@
         if (!PyArg_ParseTuple(args, "i", &param)) \
             return NULL; \
         try { \
+            GraphLock lock(self->state); \
             self->g->name(param); \
         } CATCH(NULL) \
         Py_RETURN_NONE; \
     }
 
+#define METHOD_VOIDINTINT(obj, name) \
+    static PyObject* obj ## _ ## name( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        int param1, param2; \
+        if (!PyArg_ParseTuple(args, "ii", &param1, &param2)) \
+            return NULL; \
+        try { \
+            GraphLock lock(self->state); \
+            self->g->name(param1, param2); \
+        } CATCH(NULL) \
+        Py_RETURN_NONE; \
+    }
+
+#define METHOD_VOIDDOUBLE(obj, name) \
+    static PyObject* obj ## _ ## name( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        double param; \
+        if (!PyArg_ParseTuple(args, "d", &param)) \
+            return NULL; \
+        try { \
+            GraphLock lock(self->state); \
+            self->g->name(param); \
+        } CATCH(NULL) \
+        Py_RETURN_NONE; \
+    }
+
+#define METHOD_VOIDVERTICES(obj, name) \
+    static PyObject* obj ## _ ## name( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        PyObject* seq; \
+        std::vector<vertex_t> vertices; \
+        if (!PyArg_ParseTuple(args, "O", &seq)) \
+            return NULL; \
+        if (!parse_vertices(seq, vertices)) \
+            return NULL; \
+        try { \
+            GraphLock lock(self->state); \
+            self->g->name(vertices); \
+        } CATCH(NULL) \
+        Py_RETURN_NONE; \
+    }
+
+#define METHOD_VOIDEDGES(obj, name, method) \
+    static PyObject* obj ## _ ## name( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        PyObject* seq; \
+        std::vector<edge_t> edges; \
+        if (!PyArg_ParseTuple(args, "O", &seq)) \
+            return NULL; \
+        if (!parse_edges(seq, edges)) \
+            return NULL; \
+        try { \
+            GraphLock lock(self->state); \
+            self->g->method(edges); \
+        } CATCH(NULL) \
+        Py_RETURN_NONE; \
+    }
+
+// Starts name(param) in the background and returns a Future for it
+#define METHOD_ASYNCINT(obj, name) \
+    static PyObject* obj ## _ ## name ## _async( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        int param; \
+        if (!PyArg_ParseTuple(args, "i", &param)) \
+            return NULL; \
+        auto g = self->g; \
+        return submit_task(self->state, [=]() { \
+            g->name(param); \
+        }); \
+    }
+
+// Raises ValueError if the graph does not have the given properties
+#define METHOD_VERIFY(obj) \
+    static PyObject* obj ## _verify( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        const char* properties = ""; \
+        long long edges_no = -1; \
+        if (!PyArg_ParseTuple(args, "|sL", &properties, &edges_no)) \
+            return NULL; \
+        try { \
+            GraphLock lock(self->state); \
+            self->g->verify(verifier::parse_properties(properties), edges_no); \
+        } CATCH(NULL) \
+        Py_RETURN_NONE; \
+    }
+
+#define METHOD_LOAD(obj) \
+    static PyObject* obj ## _load( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        const char* path; \
+        long long first_label = 0; \
+        if (!PyArg_ParseTuple(args, "s|L", &path, &first_label)) \
+            return NULL; \
+        try { \
+            GraphLock lock(self->state); \
+            self->g->load(path, first_label); \
+        } CATCH(NULL) \
+        Py_RETURN_NONE; \
+    }
+
+// Return read-only Arrays with snapshots of the edges (one row per edge),
+// of the stored weights and of the degrees of the vertices
+#define METHOD_ARRAYS(obj) \
+    static PyObject* obj ## _edges(obj ## Obj* self) { \
+        std::vector<uint32_t> edges; \
+        try { \
+            GraphLock lock(self->state); \
+            edges = self->g->edge_array(); \
+        } CATCH(NULL) \
+        return make_array(new ArrayDataOf<uint32_t>(std::move(edges)), 2); \
+    } \
+    static PyObject* obj ## _weights(obj ## Obj* self) { \
+        std::vector<pyObject> values; \
+        try { \
+            GraphLock lock(self->state, false); \
+            if (!self->g->has_weights()) \
+                throw NoWeightsException(); \
+            values = self->g->weight_array(); \
+        } CATCH(NULL) \
+        return weights_array(values); \
+    } \
+    static PyObject* obj ## _degrees(obj ## Obj* self) { \
+        std::vector<uint32_t> degrees; \
+        try { \
+            GraphLock lock(self->state); \
+            degrees = self->g->degree_array(); \
+        } CATCH(NULL) \
+        return make_array(new ArrayDataOf<uint32_t>(std::move(degrees))); \
+    }
+
+// Store random weights, integers if both ends of the range are integers,
+// or weights computed from the coordinates of the vertices
+#define METHOD_WEIGHTS(obj) \
+    static PyObject* obj ## _assign_random_weights( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        PyObject *min, *max; \
+        if (!PyArg_ParseTuple(args, "OO", &min, &max)) \
+            return NULL; \
+        std::unique_ptr<Weighter<pyObject>> weighter; \
+        if (PyInt_Check(min) && PyInt_Check(max)) { \
+            long a = PyInt_AsLong(min), b = PyInt_AsLong(max); \
+            if (a >= b || a < INT_MIN || b > INT_MAX) { \
+                PyErr_SetString(PyExc_ValueError, "Invalid range of weights"); \
+                return NULL; \
+            } \
+            weighter.reset(new pyWeighterWrapper<int>(new RandomWeighter<int>(a, b))); \
+        } else { \
+            double a = PyFloat_AsDouble(min), b = PyFloat_AsDouble(max); \
+            if (PyErr_Occurred()) \
+                return NULL; \
+            if (!(a < b)) { \
+                PyErr_SetString(PyExc_ValueError, "Invalid range of weights"); \
+                return NULL; \
+            } \
+            weighter.reset(new pyWeighterWrapper<double>(new RandomWeighter<double>(a, b))); \
+        } \
+        try { \
+            GraphLock lock(self->state); \
+            self->g->assign_weights(*weighter); \
+        } CATCH(NULL) \
+        Py_RETURN_NONE; \
+    } \
+    static PyObject* obj ## _assign_euclidean_weights( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        double scale = 1; \
+        if (!PyArg_ParseTuple(args, "|d", &scale)) \
+            return NULL; \
+        try { \
+            GraphLock lock(self->state); \
+            self->g->assign_euclidean_weights(scale); \
+        } CATCH(NULL) \
+        Py_RETURN_NONE; \
+    }
+
+#define METHOD_FINGERPRINT(obj) \
+    static PyObject* obj ## _fingerprint( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        int invariant = 0, rounds = 3; \
+        if (!PyArg_ParseTuple(args, "|ii", &invariant, &rounds)) \
+            return NULL; \
+        std::string res; \
+        try { \
+            /* The stored weights are Python objects */ \
+            GraphLock lock(self->state, false); \
+            res = (invariant ? self->g->invariant_fingerprint(rounds) \
+                             : self->g->fingerprint()).to_string(); \
+        } CATCH(NULL) \
+        return PyString_FromString(res.c_str()); \
+    }
+
+#define METHOD_COMPONENTS(obj) \
+    static PyObject* obj ## _track_components( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        int enable = 1; \
+        if (!PyArg_ParseTuple(args, "|i", &enable)) \
+            return NULL; \
+        try { \
+            GraphLock lock(self->state); \
+            self->g->track_components(enable); \
+        } CATCH(NULL) \
+        Py_RETURN_NONE; \
+    } \
+    static PyObject* obj ## _component_count(obj ## Obj* self) { \
+        size_t count; \
+        try { \
+            GraphLock lock(self->state); \
+            count = self->g->component_count(); \
+        } CATCH(NULL) \
+        return PyInt_FromSize_t(count); \
+    } \
+    static PyObject* obj ## _same_component( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        int a, b; \
+        bool same; \
+        if (!PyArg_ParseTuple(args, "ii", &a, &b)) \
+            return NULL; \
+        try { \
+            GraphLock lock(self->state); \
+            same = self->g->same_component(a, b); \
+        } CATCH(NULL) \
+        return PyBool_FromLong(same); \
+    }
+
+#define METHOD_WRITE(obj) \
+    static PyObject* obj ## _write( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        const char* filename; \
+        if (!PyArg_ParseTuple(args, "s", &filename)) \
+            return NULL; \
+        return write_to_file(filename, [&](std::ostream& os) { \
+            GraphLock lock(self->state, IS_NATIVE(self)); \
+            self->g->write(os); \
+        }); \
+    } \
+    static PyObject* obj ## _write_with_random_edges( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        const char* filename; \
+        Py_ssize_t edges_no, memory_budget = Py_ssize_t(1) << 30; \
+        if (!PyArg_ParseTuple(args, "sn|n", &filename, &edges_no, &memory_budget)) \
+            return NULL; \
+        return write_to_file(filename, [&](std::ostream& os) { \
+            GraphLock lock(self->state, IS_NATIVE(self)); \
+            self->g->write_with_random_edges(os, edges_no, memory_budget); \
+        }); \
+    } \
+    static PyObject* obj ## _write_updates( \
+        obj ## Obj* self, \
+        PyObject *args, \
+        PyObject *kwds \
+    ) { \
+        const char *filename, *answers_filename; \
+        Py_ssize_t operations_no; \
+        double inserts = 1, removes = 1, queries = 1; \
+        if (!PyArg_ParseTuple(args, "ssn|ddd", &filename, &answers_filename, \
+                              &operations_no, &inserts, &removes, &queries)) \
+            return NULL; \
+        PyObject* res = NULL; \
+        PyObject* answers_res = write_to_file(answers_filename, [&](std::ostream& answers) { \
+            res = write_to_file(filename, [&](std::ostream& os) { \
+                GraphLock lock(self->state, IS_NATIVE(self)); \
+                self->g->write_updates(os, answers, operations_no, inserts, removes, queries); \
+            }); \
+        }); \
+        if (!answers_res || !res) { \
+            Py_XDECREF(answers_res); \
+            Py_XDECREF(res); \
+            return NULL; \
+        } \
+        Py_DECREF(answers_res); \
+        return res; \
+    }
+
 #define ADD_OBJECT(module, obj) \
         if (PyType_Ready(&obj ## Type) < 0) return; \
         Py_INCREF(&obj ## Type); \
@@ -57,7 +374,7 @@
         0,                                  /* tp_setattr */ \
         0,                                  /* tp_compare */ \
         0,                                  /* tp_repr */ \
-        0,                                  /* tp_as_number */ \
+        obj ## _as_number,                  /* tp_as_number */ \
         0,                                  /* tp_as_sequence */ \
         0,                                  /* tp_as_mapping */ \
         0,                                  /* tp_hash */ \
@@ -66,7 +383,7 @@
         0,                                  /* tp_getattro */ \
         0,                                  /* tp_setattro */ \
         0,                                  /* tp_as_buffer */ \
-        Py_TPFLAGS_DEFAULT,                 /* tp_flags */ \
+        Py_TPFLAGS_DEFAULT | Py_TPFLAGS_CHECKTYPES, /* tp_flags */ \
         doc,                                /* tp_doc */ \
         0,                                  /* tp_traverse */ \
         0,                                  /* tp_clear */ \
@@ -87,6 +404,83 @@
         PyType_GenericNew                   /* tp_new */ \
     };
 
+// Tells whether the graph can be used without holding the GIL, that is if
+// its labeler and weighter do not call back into Python
+#define IS_NATIVE(self) \
+    ((self)->labeler->is_thread_safe() && (self)->weighter->is_thread_safe())
+
+#define GRAPH_BINARY_OP(obj, name, first, second) \
+    static PyObject* obj ## _ ## name(PyObject* a, PyObject* b) { \
+        if (Py_TYPE(a) != Py_TYPE(b)) { \
+            Py_INCREF(Py_NotImplemented); \
+            return Py_NotImplemented; \
+        } \
+        obj ## Obj* res = (obj ## Obj*) PyObject_CallFunction( \
+            (PyObject*) Py_TYPE(a), \
+            const_cast<char*>("i"), \
+            0 \
+        ); \
+        if (!res) return NULL; \
+        try { \
+            GraphPairLock lock(((obj ## Obj*)a)->state, ((obj ## Obj*)b)->state); \
+            res->g->first(*((obj ## Obj*)a)->g); \
+            res->g->second(*((obj ## Obj*)b)->g); \
+        } catch(std::exception& e) { \
+            Py_DECREF(res); \
+            PyErr_SetString(PyExc_ValueError, e.what()); \
+            return NULL; \
+        } \
+        return (PyObject*) res; \
+    }
+
+// Defines the number protocol of a graph type: ~ is the complement, | the
+// union, & the intersection, + the disjoint union and * the cartesian
+// product. The operands are left untouched: each operation starts from an
+// empty graph, copies the first operand into it and then works in place.
+#define NUMBER_METHODS(obj) \
+    GRAPH_BINARY_OP(obj, or, union_with, union_with) \
+    GRAPH_BINARY_OP(obj, and, union_with, intersect_with) \
+    GRAPH_BINARY_OP(obj, add, disjoint_union_with, disjoint_union_with) \
+    GRAPH_BINARY_OP(obj, multiply, union_with, cartesian_product_with) \
+    static PyObject* obj ## _invert(PyObject* a) { \
+        obj ## Obj* res = (obj ## Obj*) PyObject_CallFunction( \
+            (PyObject*) Py_TYPE(a), \
+            const_cast<char*>("i"), \
+            0 \
+        ); \
+        if (!res) return NULL; \
+        try { \
+            GraphLock lock(((obj ## Obj*)a)->state); \
+            res->g->union_with(*((obj ## Obj*)a)->g); \
+            res->g->complement(); \
+        } catch(std::exception& e) { \
+            Py_DECREF(res); \
+            PyErr_SetString(PyExc_ValueError, e.what()); \
+            return NULL; \
+        } \
+        return (PyObject*) res; \
+    } \
+    static PyNumberMethods obj ## _number_methods = { \
+        (binaryfunc) obj ## _add,           /* nb_add */ \
+        0,                                  /* nb_subtract */ \
+        (binaryfunc) obj ## _multiply,      /* nb_multiply */ \
+        0,                                  /* nb_divide */ \
+        0,                                  /* nb_remainder */ \
+        0,                                  /* nb_divmod */ \
+        0,                                  /* nb_power */ \
+        0,                                  /* nb_negative */ \
+        0,                                  /* nb_positive */ \
+        0,                                  /* nb_absolute */ \
+        0,                                  /* nb_nonzero */ \
+        (unaryfunc) obj ## _invert,         /* nb_invert */ \
+        0,                                  /* nb_lshift */ \
+        0,                                  /* nb_rshift */ \
+        (binaryfunc) obj ## _and,           /* nb_and */ \
+        0,                                  /* nb_xor */ \
+        (binaryfunc) obj ## _or,            /* nb_or */ \
+    }; \
+    static PyNumberMethods* obj ## _as_number = &obj ## _number_methods;
+
 
 class PythonException: public std::exception {
     virtual const char* what() const noexcept {
@@ -124,6 +518,25 @@ struct pyObject {
         stored_val._PyObject = v;
     }
 
+    pyObject(const pyObject& other):
+        stored_val(other.stored_val), type(other.type) {
+        if (type == VAL_PYOBJECT) {
+            Py_INCREF(stored_val._PyObject);
+        }
+    }
+
+    pyObject& operator=(const pyObject& other) {
+        if (other.type == VAL_PYOBJECT) {
+            Py_INCREF(other.stored_val._PyObject);
+        }
+        if (type == VAL_PYOBJECT) {
+            Py_DECREF(stored_val._PyObject);
+        }
+        stored_val = other.stored_val;
+        type = other.type;
+        return *this;
+    }
+
     ~pyObject() {
         if (type == VAL_PYOBJECT) {
             Py_DECREF(stored_val._PyObject);
@@ -171,6 +584,10 @@ public:
         T val = (*l)(v);
         return val;
     }
+
+    bool is_thread_safe() const override {
+        return l->is_thread_safe();
+    }
 };
 
 template<typename T>
@@ -179,7 +596,7 @@ private:
     Weighter<T>* w;
 
 public:
-    pyWeighterWrapper(Weighter<T>& w): w(w) {}
+    pyWeighterWrapper(Weighter<T>* w): w(w) {}
     ~pyWeighterWrapper() {
         delete w;
     }
@@ -187,6 +604,10 @@ public:
     pyObject operator()(const edge_t& e) override {
         return (*w)(e);
     }
+
+    bool is_thread_safe() const override {
+        return w->is_thread_safe();
+    }
 };
 
 // I hate void
@@ -205,6 +626,10 @@ public:
     pyObject operator()(const edge_t& e) override {
         return pyObject();
     }
+
+    bool is_thread_safe() const override {
+        return true;
+    }
 };
 
 // Both pyLabeler and pyWeighter will fail horribly if the object passed
@@ -234,6 +659,11 @@ public:
         Py_DECREF(res);
         return obj;
     }
+
+    // Python callables must only be called while holding the GIL
+    bool is_thread_safe() const override {
+        return false;
+    }
 };
 
 class pyWeighter: public Weighter<pyObject> {
@@ -261,6 +691,167 @@ public:
         Py_DECREF(res);
         return obj;
     }
+
+    // Python callables must only be called while holding the GIL
+    bool is_thread_safe() const override {
+        return false;
+    }
+};
+
+// Conversion of Python sequences to vertices and edges. They return false
+// (with the Python exception set) if the sequence is malformed.
+
+bool parse_vertices(PyObject* seq, std::vector<vertex_t>& vertices) {
+    PyObject* fast = PySequence_Fast(seq, "A sequence of vertices is needed!");
+    if (!fast) return false;
+    Py_ssize_t len = PySequence_Fast_GET_SIZE(fast);
+    vertices.resize(len);
+    for (Py_ssize_t i = 0; i < len; i++) {
+        Py_ssize_t v = PyNumber_AsSsize_t(PySequence_Fast_GET_ITEM(fast, i), NULL);
+        if (v == -1 && PyErr_Occurred()) {
+            Py_DECREF(fast);
+            return false;
+        }
+        vertices[i] = v;
+    }
+    Py_DECREF(fast);
+    return true;
+}
+
+bool parse_edges(PyObject* seq, std::vector<edge_t>& edges) {
+    PyObject* fast = PySequence_Fast(seq, "A sequence of edges is needed!");
+    if (!fast) return false;
+    Py_ssize_t len = PySequence_Fast_GET_SIZE(fast);
+    edges.resize(len);
+    for (Py_ssize_t i = 0; i < len; i++) {
+        Py_ssize_t a, b;
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(fast, i), "nn", &a, &b)) {
+            Py_DECREF(fast);
+            return false;
+        }
+        edges[i].tail = a;
+        edges[i].head = b;
+    }
+    Py_DECREF(fast);
+    return true;
+}
+
+// The state of a graph object that is shared with its background tasks:
+// the mutex that serializes the operations on the graph, and the last task
+// submitted on it. Tasks on the same graph run in order of submission.
+struct GraphState {
+    std::mutex mutex;
+    std::shared_future<void> last;
+};
+
+// Waits for the background tasks of a graph, without holding the GIL
+void wait_pending(GraphState* state) {
+    std::shared_future<void> last = state->last;
+    if (!last.valid()) return;
+    Py_BEGIN_ALLOW_THREADS
+    last.wait();
+    Py_END_ALLOW_THREADS
+}
+
+// Gives exclusive access to a graph for the lifetime of the object, after
+// its background tasks are done. If release is true, the GIL is released
+// in the meantime, so that other Python threads can run.
+class GraphLock {
+private:
+    PyThreadState* thread_state;
+    std::unique_lock<std::mutex> lock;
+
+public:
+    GraphLock(GraphState* state, bool release = true): thread_state(NULL) {
+        // state->last is only modified while holding the GIL
+        std::shared_future<void> last = state->last;
+        if (release)
+            thread_state = PyEval_SaveThread();
+        if (last.valid())
+            last.wait();
+        lock = std::unique_lock<std::mutex>(state->mutex);
+    }
+
+    ~GraphLock() {
+        lock.unlock();
+        if (thread_state)
+            PyEval_RestoreThread(thread_state);
+    }
+};
+
+// Same as GraphLock, for the two operands of a binary operation. The
+// mutexes are always taken in the same order, to avoid deadlocks.
+class GraphPairLock {
+private:
+    std::unique_ptr<GraphLock> first, second;
+
+public:
+    GraphPairLock(GraphState* a, GraphState* b) {
+        if (b < a) std::swap(a, b);
+        first.reset(new GraphLock(a));
+        if (b != a)
+            second.reset(new GraphLock(b, false));
+    }
+
+    ~GraphPairLock() {
+        second.reset();
+        first.reset();
+    }
+};
+
+// Calls write on a stream that goes to the given file, compressing the
+// output if the name of the file ends with .gz
+template<typename F>
+PyObject* write_to_file(const char* filename, F write) {
+    std::string name(filename);
+    std::ofstream file(filename, std::ios::binary);
+    if (!file)
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, filename);
+    try {
+        if (name.size() >= 3 && name.substr(name.size() - 3) == ".gz") {
+            GzipStreambuf buf(file);
+            std::ostream os(&buf);
+            write(os);
+            // A failed write leaves the stream truncated, without trailer
+            if (!os)
+                throw IOException();
+            buf.close();
+        } else {
+            write(file);
+        }
+    } CATCH(NULL)
+    file.close();
+    if (!file)
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, filename);
+    Py_RETURN_NONE;
+}
+
+// Owns the memory viewed by an Array, and describes its items in the
+// format of the struct module
+struct ArrayData {
+    void* data;
+    const char* format;
+    Py_ssize_t itemsize, size;
+
+    virtual ~ArrayData() {}
+};
+
+template<typename T> const char* buffer_format();
+template<> const char* buffer_format<uint32_t>() { return "I"; }
+template<> const char* buffer_format<uint64_t>() { return "Q"; }
+template<> const char* buffer_format<int64_t>() { return "q"; }
+template<> const char* buffer_format<double>() { return "d"; }
+
+template<typename T>
+struct ArrayDataOf: public ArrayData {
+    std::vector<T> values;
+
+    ArrayDataOf(std::vector<T>&& v): values(std::move(v)) {
+        data = values.data();
+        format = buffer_format<T>();
+        itemsize = sizeof(T);
+        size = values.size();
+    }
 };
 
 extern "C" {
@@ -275,8 +866,74 @@ extern "C" {
         Py_RETURN_NONE;
     }
 
+    // Returns a dict with the time spent in each phase, the number of
+    // times it was entered, and the counters. They are all zero unless the
+    // module was compiled with GRAPHGEN_STATS.
+    static PyObject* GG_stats(PyObject* self) {
+        stats::Stats st = stats::get();
+        PyObject* res = PyDict_New();
+        if (!res) return NULL;
+        for (size_t i = 0; i < stats::PHASES_NO; i++) {
+            const char* name = stats::phase_name(stats::phase_t(i));
+            PyObject* phase = Py_BuildValue(
+                "{s:d,s:K}",
+                "seconds", st.seconds[i],
+                "calls", (unsigned long long) st.calls[i]
+            );
+            if (!phase || PyDict_SetItemString(res, name, phase) < 0) {
+                Py_XDECREF(phase);
+                Py_DECREF(res);
+                return NULL;
+            }
+            Py_DECREF(phase);
+        }
+        for (size_t i = 0; i < stats::COUNTERS_NO; i++) {
+            const char* name = stats::counter_name(stats::counter_t(i));
+            PyObject* value = PyLong_FromUnsignedLongLong(st.counters[i]);
+            if (!value || PyDict_SetItemString(res, name, value) < 0) {
+                Py_XDECREF(value);
+                Py_DECREF(res);
+                return NULL;
+            }
+            Py_DECREF(value);
+        }
+#ifdef GRAPHGEN_STATS
+        PyDict_SetItemString(res, "enabled", Py_True);
+#else
+        PyDict_SetItemString(res, "enabled", Py_False);
+#endif
+        return res;
+    }
+
+    static PyObject* GG_reset_stats(PyObject* self) {
+        stats::reset();
+        Py_RETURN_NONE;
+    }
+
+    static PyObject* GG_start_trace(PyObject* self) {
+        stats::start_trace();
+        Py_RETURN_NONE;
+    }
+
+    static PyObject* GG_write_trace(PyObject* self, PyObject* args) {
+        const char* filename;
+        if (!PyArg_ParseTuple(args, "s", &filename))
+            return NULL;
+        stats::stop_trace();
+        std::ofstream file(filename);
+        stats::write_trace(file);
+        file.close();
+        if (!file)
+            return PyErr_SetFromErrnoWithFilename(PyExc_IOError, filename);
+        Py_RETURN_NONE;
+    }
+
     static PyMethodDef graphgen_methods[] = {
         DEF_ARGS(GG, srand, "Call srand()."),
+        DEF_NOARGS(GG, stats, "Return the time spent in each phase and the counters."),
+        DEF_NOARGS(GG, reset_stats, "Reset the times and counters."),
+        DEF_NOARGS(GG, start_trace, "Start recording the phases for a Chrome trace."),
+        DEF_ARGS(GG, write_trace, "Stop recording and write the Chrome trace to a file."),
         {NULL}
     };
 
@@ -284,14 +941,15 @@ extern "C" {
 
     typedef struct {
         PyObject_HEAD
-        std::vector<int64_t>::iterator it;
-        std::vector<int64_t>::iterator end;
+        RangeSampler::iterator it;
+        RangeSampler::iterator end;
     } RangeSamplerIteratorObj;
 
     static initproc RangeSamplerIterator_init = 0;
     static reprfunc RangeSamplerIterator_str = 0;
     static PyMethodDef* RangeSamplerIterator_methods = 0;
     static getiterfunc RangeSamplerIterator_iter = PyObject_SelfIter;
+    static PyNumberMethods* RangeSamplerIterator_as_number = 0;
 
     static void RangeSamplerIterator_dealloc(PyObject* self) {
         self->ob_type->tp_free(self);
@@ -319,6 +977,7 @@ extern "C" {
     static reprfunc RangeSampler_str = 0;
     static PyMethodDef* RangeSampler_methods = 0;
     static iternextfunc RangeSampler_iternext = 0;
+    static PyNumberMethods* RangeSampler_as_number = 0;
 
     static void RangeSampler_dealloc(RangeSamplerObj* self) {
         if (self->rs)
@@ -356,6 +1015,180 @@ extern "C" {
 
     NEW_TYPE(RangeSampler, "RangeSampler")
 
+    // Future
+
+    typedef struct {
+        PyObject_HEAD
+        std::shared_future<void>* future;
+    } FutureObj;
+
+    static initproc Future_init = 0;
+    static reprfunc Future_str = 0;
+    static getiterfunc Future_iter = 0;
+    static iternextfunc Future_iternext = 0;
+    static PyNumberMethods* Future_as_number = 0;
+
+    static void Future_dealloc(FutureObj* self) {
+        if (self->future)
+            delete self->future;
+        self->ob_type->tp_free((PyObject*)self);
+    }
+
+    static PyObject* Future_done(FutureObj* self) {
+        if (!self->future) Py_RETURN_TRUE;
+        auto status = self->future->wait_for(std::chrono::seconds(0));
+        if (status == std::future_status::ready) {
+            Py_RETURN_TRUE;
+        } else {
+            Py_RETURN_FALSE;
+        }
+    }
+
+    static PyObject* Future_result(FutureObj* self) {
+        if (!self->future) Py_RETURN_NONE;
+        Py_BEGIN_ALLOW_THREADS
+        self->future->wait();
+        Py_END_ALLOW_THREADS
+        try {
+            self->future->get();
+        } CATCH(NULL)
+        Py_RETURN_NONE;
+    }
+
+    static PyMethodDef Future_methods[] = {
+        DEF_NOARGS(Future, done, "Tell whether the operation is finished."),
+        DEF_NOARGS(Future, result, "Wait for the operation to finish, and raise its exception if it failed."),
+        {NULL}
+    };
+
+    NEW_TYPE(Future, "Result of an operation running in the background")
+
+    // Array
+
+    typedef struct {
+        PyObject_HEAD
+        ArrayData* owner;
+        int ndim;
+        Py_ssize_t shape[2];
+        Py_ssize_t strides[2];
+    } ArrayObj;
+
+    static initproc Array_init = 0;
+    static reprfunc Array_str = 0;
+    static getiterfunc Array_iter = 0;
+    static iternextfunc Array_iternext = 0;
+    static PyNumberMethods* Array_as_number = 0;
+    static PyMethodDef* Array_methods = 0;
+
+    static void Array_dealloc(ArrayObj* self) {
+        if (self->owner)
+            delete self->owner;
+        self->ob_type->tp_free((PyObject*)self);
+    }
+
+    static int Array_getbuffer(ArrayObj* self, Py_buffer* view, int flags) {
+        view->obj = NULL;
+        if (!self->owner) {
+            PyErr_SetString(PyExc_BufferError, "The array is empty");
+            return -1;
+        }
+        if (flags & PyBUF_WRITABLE) {
+            PyErr_SetString(PyExc_BufferError, "The array is read-only");
+            return -1;
+        }
+        view->buf = self->owner->data;
+        view->obj = (PyObject*) self;
+        Py_INCREF(self);
+        view->len = self->owner->size * self->owner->itemsize;
+        view->readonly = 1;
+        view->itemsize = self->owner->itemsize;
+        view->format = (flags & PyBUF_FORMAT) ? const_cast<char*>(self->owner->format) : NULL;
+        view->ndim = self->ndim;
+        // The data is contiguous, so it can also be viewed as plain bytes
+        view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+        view->strides = (flags & PyBUF_STRIDES) ? self->strides : NULL;
+        view->suboffsets = NULL;
+        view->internal = NULL;
+        return 0;
+    }
+
+    static PyBufferProcs Array_as_buffer = {
+        0, 0, 0, 0,
+        (getbufferproc) Array_getbuffer,
+        0
+    };
+
+    NEW_TYPE(Array, "Read-only array exported with the buffer protocol, see numpy.asarray")
+
+    // Returns an Array that takes ownership of the data, viewed as a
+    // matrix with the given number of columns (or a vector if it is 1)
+    static PyObject* make_array(ArrayData* owner, const Py_ssize_t columns = 1) {
+        ArrayObj* res = (ArrayObj*) PyType_GenericAlloc(&ArrayType, 0);
+        if (!res) {
+            delete owner;
+            return NULL;
+        }
+        res->owner = owner;
+        res->ndim = columns == 1 ? 1 : 2;
+        res->shape[0] = owner->size / columns;
+        res->shape[1] = columns;
+        res->strides[0] = columns * owner->itemsize;
+        res->strides[1] = owner->itemsize;
+        return (PyObject*) res;
+    }
+
+    // Returns an Array with the given weights, as integers if they all are
+    // integers, and as doubles otherwise
+    static PyObject* weights_array(const std::vector<pyObject>& values) {
+        bool integral = true;
+        for (const pyObject& v: values) {
+            if (v.type == pyObject::VAL_DOUBLE) {
+                integral = false;
+            } else if (v.type != pyObject::VAL_INT) {
+                PyErr_SetString(PyExc_ValueError, "The weights are not numbers");
+                return NULL;
+            }
+        }
+        if (integral) {
+            std::vector<int64_t> res(values.size());
+            for (size_t i = 0; i < values.size(); i++)
+                res[i] = values[i].stored_val._int;
+            return make_array(new ArrayDataOf<int64_t>(std::move(res)));
+        }
+        std::vector<double> res(values.size());
+        for (size_t i = 0; i < values.size(); i++)
+            res[i] = values[i].type == pyObject::VAL_INT ?
+                values[i].stored_val._int : values[i].stored_val._double;
+        return make_array(new ArrayDataOf<double>(std::move(res)));
+    }
+
+    // Runs task on the background thread pool, after the previous tasks on
+    // the same graph, and returns a Future for it. The random generator of
+    // the worker is seeded from the one of the caller, so the results do
+    // not depend on how the tasks are scheduled.
+    static PyObject* submit_task(GraphState* state, std::function<void()> task) {
+        std::shared_future<void> previous = state->last;
+        uint64_t seed = Random::xor128();
+        FutureObj* res = (FutureObj*) PyType_GenericAlloc(&FutureType, 0);
+        if (!res) return NULL;
+        try {
+            std::future<void> future = utils::background_pool().submit([=]() {
+                if (previous.valid())
+                    previous.wait();
+                std::lock_guard<std::mutex> lock(state->mutex);
+                Random::seed(seed);
+                task();
+            });
+            res->future = new std::shared_future<void>(future.share());
+        } catch(std::exception& e) {
+            Py_DECREF(res);
+            PyErr_SetString(PyExc_ValueError, e.what());
+            return NULL;
+        }
+        state->last = *res->future;
+        return (PyObject*) res;
+    }
+
     // DisjointSet
 
     typedef struct {
@@ -366,6 +1199,7 @@ extern "C" {
     static reprfunc DisjointSet_str = 0;
     static getiterfunc DisjointSet_iter = 0;
     static iternextfunc DisjointSet_iternext = 0;
+    static PyNumberMethods* DisjointSet_as_number = 0;
 
     static void DisjointSet_dealloc(DisjointSetObj* self) {
         if (self->disjoint_set)
@@ -434,19 +1268,30 @@ extern "C" {
 
     NEW_TYPE(DisjointSet, "Disjoint Set data structure.")
 
+    // Each graph takes the memory of its edges from its own arena, which is
+    // given back all at once when the graph is destroyed
+    typedef utils::ArenaAllocator<char> pyAllocator;
+    typedef UndirectedGraph<pyObject, pyObject, uint32_t, pyAllocator> pyUndirectedGraph;
+    typedef DirectedGraph<pyObject, pyObject, uint32_t, pyAllocator> pyDirectedGraph;
+
     // UndirectedGraph
 
     typedef struct {
         PyObject_HEAD
-        UndirectedGraph<pyObject, pyObject>* g;
+        pyUndirectedGraph* g;
         Labeler<pyObject>* labeler;
         Weighter<pyObject>* weighter;
+        GraphState* state;
     } UndirectedGraphObj;
 
     static getiterfunc UndirectedGraph_iter = 0;
     static iternextfunc UndirectedGraph_iternext = 0;
 
     static void UndirectedGraph_dealloc(UndirectedGraphObj* self) {
+        if (self->state) {
+            wait_pending(self->state);
+            delete self->state;
+        }
         if (self->g) delete self->g;
         if (self->labeler) delete self->labeler;
         if (self->weighter) delete self->weighter;
@@ -463,26 +1308,35 @@ extern "C" {
             return -1;
         if (self->g) {
             // Someone who feels playful could call __init__() twice
+            wait_pending(self->state);
             delete self->g;
             delete self->labeler;
             delete self->weighter;
             self->g = NULL;
         }
         try {
+            if (!self->state)
+                self->state = new GraphState();
             self->labeler = new pyLabelerWrapper<int>(new IotaLabeler());
             self->weighter = new pyWeighterWrapper<void>(new NoWeighter());
-            self->g = new UndirectedGraph<pyObject, pyObject>(
+            self->g = new pyUndirectedGraph(
                 sz,
                 *(self->labeler),
-                *(self->weighter)
+                *(self->weighter),
+                pyAllocator::owning()
             );
         } CATCH(-1)
         return 0;
     }
 
     static PyObject* UndirectedGraph_str(PyObject* self) {
+        UndirectedGraphObj* graph = (UndirectedGraphObj*)self;
         try {
-            const std::string& repr = ((UndirectedGraphObj*)self)->g->to_string();
+            std::string repr;
+            {
+                GraphLock lock(graph->state, IS_NATIVE(graph));
+                repr = graph->g->to_string();
+            }
             return PyString_FromStringAndSize(repr.c_str(), repr.size()-1);
         } CATCH(NULL)
     }
@@ -496,25 +1350,78 @@ extern "C" {
         if (!PyArg_ParseTuple(args, "ii", &a, &b))
             return NULL;
         try {
+            GraphLock lock(self->state);
             self->g->add_edge(a, b);
         } CATCH(NULL)
         Py_RETURN_NONE;
     }
 
+    static PyObject* UndirectedGraph_build_regular (
+        UndirectedGraphObj* self,
+        PyObject *args,
+        PyObject *kwds
+    ) {
+        int degree, switches = 0;
+        if (!PyArg_ParseTuple(args, "i|i", &degree, &switches))
+            return NULL;
+        try {
+            GraphLock lock(self->state);
+            self->g->build_regular(degree, switches);
+        } CATCH(NULL)
+        Py_RETURN_NONE;
+    }
+
     METHOD_VOIDINT(UndirectedGraph, add_edges)
+    METHOD_ASYNCINT(UndirectedGraph, add_edges)
     METHOD_VOIDINT(UndirectedGraph, build_forest)
     METHOD_VOIDVOID(UndirectedGraph, connect)
+    METHOD_VOIDVOID(UndirectedGraph, random_spanning_tree)
     METHOD_VOIDVOID(UndirectedGraph, build_path)
     METHOD_VOIDVOID(UndirectedGraph, build_cycle)
     METHOD_VOIDVOID(UndirectedGraph, build_tree)
     METHOD_VOIDVOID(UndirectedGraph, build_star)
     METHOD_VOIDVOID(UndirectedGraph, build_wheel)
     METHOD_VOIDVOID(UndirectedGraph, build_clique)
+    METHOD_VOIDINTINT(UndirectedGraph, remove_edge)
+    METHOD_VOIDEDGES(UndirectedGraph, add_edge_list, add_edge_list)
+    METHOD_VOIDEDGES(UndirectedGraph, remove_edges, remove_edge_list)
+    METHOD_VOIDINT(UndirectedGraph, sample_edges)
+    METHOD_VOIDVERTICES(UndirectedGraph, induced_subgraph)
+    METHOD_WRITE(UndirectedGraph)
+    METHOD_VERIFY(UndirectedGraph)
+    METHOD_LOAD(UndirectedGraph)
+    METHOD_ARRAYS(UndirectedGraph)
+    METHOD_WEIGHTS(UndirectedGraph)
+    METHOD_COMPONENTS(UndirectedGraph)
+    METHOD_FINGERPRINT(UndirectedGraph)
+    METHOD_VOIDDOUBLE(UndirectedGraph, build_geometric)
+    METHOD_VOIDINTINT(UndirectedGraph, build_grid)
 
     static PyMethodDef UndirectedGraph_methods[] = {
         DEF_ARGS(UndirectedGraph, add_edge, "Add an edge to the graph."),
         DEF_ARGS(UndirectedGraph, add_edges, "Add some new edges to the graph."),
+        DEF_ARGS(UndirectedGraph, add_edges_async, "Add some new edges to the graph in the background, and return a Future."),
+        DEF_ARGS(UndirectedGraph, add_edge_list, "Add a list of edges to the graph."),
+        DEF_ARGS(UndirectedGraph, remove_edge, "Remove an edge from the graph."),
+        DEF_ARGS(UndirectedGraph, remove_edges, "Remove a list of edges from the graph."),
+        DEF_ARGS(UndirectedGraph, sample_edges, "Keep only M random edges of the graph."),
+        DEF_ARGS(UndirectedGraph, induced_subgraph, "Keep only the subgraph induced by the given vertices."),
+        DEF_ARGS(UndirectedGraph, write, "Write the graph to a file, compressed with gzip if its name ends with .gz."),
+        DEF_NOARGS(UndirectedGraph, edges, "Return a read-only array (see numpy.asarray) with one row (tail, head) per edge."),
+        DEF_NOARGS(UndirectedGraph, weights, "Return a read-only array with the stored weights, in the order of edges()."),
+        DEF_ARGS(UndirectedGraph, assign_random_weights, "Store random weights in the range [min, max), integers if both ends are integers and floats otherwise."),
+        DEF_ARGS(UndirectedGraph, assign_euclidean_weights, "Store as weights the distances between the endpoints of the edges, times scale (default 1), after build_geometric or build_grid."),
+        DEF_NOARGS(UndirectedGraph, degrees, "Return a read-only array with the degree of each vertex."),
+        DEF_ARGS(UndirectedGraph, load, "Replace the graph with the one in a file written by write, optionally with the label of the first vertex."),
+        DEF_ARGS(UndirectedGraph, write_with_random_edges, "Write the graph with M more random edges to a file, using temporary files to save memory."),
+        DEF_ARGS(UndirectedGraph, write_updates, "Write the graph and Q random insertions, removals and connectivity queries to a file, and the answers to the queries to another."),
         DEF_NOARGS(UndirectedGraph, connect, "Make the graph connected."),
+        DEF_NOARGS(UndirectedGraph, random_spanning_tree, "Replace the edges with a uniformly random spanning tree (or forest) of the graph."),
+        DEF_ARGS(UndirectedGraph, track_components, "Keep the connected components up to date as edges are added (or stop, if False), making connect and the queries cheap."),
+        DEF_NOARGS(UndirectedGraph, component_count, "Return the number of connected components."),
+        DEF_ARGS(UndirectedGraph, same_component, "Tell whether two vertices are in the same connected component."),
+        DEF_ARGS(UndirectedGraph, fingerprint, "Return a hash of the graph as 32 hex digits, independent of the edge order; if invariant is True, also of the labels (optionally with the number of refinement rounds)."),
+        DEF_ARGS(UndirectedGraph, verify, "Check properties such as \"simple,connected\" and optionally the number of edges, raising ValueError if one does not hold."),
         DEF_ARGS(UndirectedGraph, build_forest, "Creates a forest with M edges."),
         DEF_NOARGS(UndirectedGraph, build_path, "Creates a path."),
         DEF_NOARGS(UndirectedGraph, build_cycle, "Creates a cycle."),
@@ -522,25 +1429,35 @@ extern "C" {
         DEF_NOARGS(UndirectedGraph, build_star, "Creates a star."),
         DEF_NOARGS(UndirectedGraph, build_wheel, "Creates a wheel."),
         DEF_NOARGS(UndirectedGraph, build_clique, "Creates a clique."),
+        DEF_ARGS(UndirectedGraph, build_geometric, "Creates a random geometric graph with the given radius."),
+        DEF_ARGS(UndirectedGraph, build_grid, "Creates a grid with the given rows and columns."),
+        DEF_ARGS(UndirectedGraph, build_regular, "Creates a random regular graph, optionally mixed with edge switches."),
         {NULL}
     };
 
+    NUMBER_METHODS(UndirectedGraph)
+
     NEW_TYPE(UndirectedGraph, "Undirected graph")
 
     // Directed graph
 
     typedef struct {
         PyObject_HEAD
-        DirectedGraph<pyObject, pyObject>* g;
+        pyDirectedGraph* g;
 
         Labeler<pyObject>* labeler;
         Weighter<pyObject>* weighter;
+        GraphState* state;
     } DirectedGraphObj;
 
     static getiterfunc DirectedGraph_iter = 0;
     static iternextfunc DirectedGraph_iternext = 0;
 
     static void DirectedGraph_dealloc(DirectedGraphObj* self) {
+        if (self->state) {
+            wait_pending(self->state);
+            delete self->state;
+        }
         if (self->g) delete self->g;
         if (self->labeler) delete self->labeler;
         if (self->weighter) delete self->weighter;
@@ -557,26 +1474,35 @@ extern "C" {
             return -1;
         if (self->g) {
             // Someone who feels playful could call __init__() twice
+            wait_pending(self->state);
             delete self->g;
             delete self->labeler;
             delete self->weighter;
             self->g = NULL;
         }
         try {
+            if (!self->state)
+                self->state = new GraphState();
             self->labeler = new pyLabelerWrapper<int>(new IotaLabeler());
             self->weighter = new pyWeighterWrapper<void>(new NoWeighter());
-            self->g = new DirectedGraph<pyObject, pyObject>(
+            self->g = new pyDirectedGraph(
                 sz,
                 *(self->labeler),
-                *(self->weighter)
+                *(self->weighter),
+                pyAllocator::owning()
             );
         } CATCH(-1)
         return 0;
     }
 
     static PyObject* DirectedGraph_str(PyObject* self) {
+        DirectedGraphObj* graph = (DirectedGraphObj*)self;
         try {
-            const std::string& repr = ((DirectedGraphObj*)self)->g->to_string();
+            std::string repr;
+            {
+                GraphLock lock(graph->state, IS_NATIVE(graph));
+                repr = graph->g->to_string();
+            }
             return PyString_FromStringAndSize(repr.c_str(), repr.size()-1);
         } CATCH(NULL)
     }
@@ -590,6 +1516,7 @@ extern "C" {
         if (!PyArg_ParseTuple(args, "ii", &a, &b))
             return NULL;
         try {
+            GraphLock lock(self->state);
             self->g->add_edge(a, b);
         } CATCH(NULL)
         Py_RETURN_NONE;
@@ -597,8 +1524,25 @@ extern "C" {
 
 
     METHOD_VOIDINT(DirectedGraph, add_edges)
+    METHOD_ASYNCINT(DirectedGraph, add_edges)
     METHOD_VOIDINT(DirectedGraph, build_forest)
     METHOD_VOIDINT(DirectedGraph, build_dag)
+
+    static PyObject* DirectedGraph_build_layered_dag(
+        DirectedGraphObj* self,
+        PyObject *args,
+        PyObject *kwds
+    ) {
+        Py_ssize_t layers, edges, span = 1;
+        int random_widths = 0;
+        if (!PyArg_ParseTuple(args, "nn|ni", &layers, &edges, &span, &random_widths))
+            return NULL;
+        try {
+            GraphLock lock(self->state);
+            self->g->build_layered_dag(layers, edges, span, random_widths);
+        } CATCH(NULL)
+        Py_RETURN_NONE;
+    }
     METHOD_VOIDVOID(DirectedGraph, connect)
     METHOD_VOIDVOID(DirectedGraph, build_path)
     METHOD_VOIDVOID(DirectedGraph, build_cycle)
@@ -606,28 +1550,79 @@ extern "C" {
     METHOD_VOIDVOID(DirectedGraph, build_star)
     METHOD_VOIDVOID(DirectedGraph, build_wheel)
     METHOD_VOIDVOID(DirectedGraph, build_clique)
+    METHOD_VOIDINTINT(DirectedGraph, remove_edge)
+    METHOD_VOIDEDGES(DirectedGraph, add_edge_list, add_edge_list)
+    METHOD_VOIDEDGES(DirectedGraph, remove_edges, remove_edge_list)
+    METHOD_VOIDINT(DirectedGraph, sample_edges)
+    METHOD_VOIDVERTICES(DirectedGraph, induced_subgraph)
+    METHOD_WRITE(DirectedGraph)
+    METHOD_VERIFY(DirectedGraph)
+    METHOD_LOAD(DirectedGraph)
+    METHOD_ARRAYS(DirectedGraph)
+    METHOD_WEIGHTS(DirectedGraph)
+    METHOD_COMPONENTS(DirectedGraph)
+    METHOD_FINGERPRINT(DirectedGraph)
+
+    static PyObject* DirectedGraph_in_degrees(DirectedGraphObj* self) {
+        std::vector<uint32_t> degrees;
+        try {
+            GraphLock lock(self->state);
+            degrees = self->g->degree_array(true);
+        } CATCH(NULL)
+        return make_array(new ArrayDataOf<uint32_t>(std::move(degrees)));
+    }
+    METHOD_VOIDDOUBLE(DirectedGraph, build_geometric)
+    METHOD_VOIDINTINT(DirectedGraph, build_grid)
 
     static PyMethodDef DirectedGraph_methods[] = {
         DEF_ARGS(DirectedGraph, add_edge, "Add an edge to the graph."),
         DEF_ARGS(DirectedGraph, add_edges, "Add some new edges to the graph."),
+        DEF_ARGS(DirectedGraph, add_edges_async, "Add some new edges to the graph in the background, and return a Future."),
+        DEF_ARGS(DirectedGraph, add_edge_list, "Add a list of edges to the graph."),
+        DEF_ARGS(DirectedGraph, remove_edge, "Remove an edge from the graph."),
+        DEF_ARGS(DirectedGraph, remove_edges, "Remove a list of edges from the graph."),
+        DEF_ARGS(DirectedGraph, sample_edges, "Keep only M random edges of the graph."),
+        DEF_ARGS(DirectedGraph, induced_subgraph, "Keep only the subgraph induced by the given vertices."),
+        DEF_ARGS(DirectedGraph, write, "Write the graph to a file, compressed with gzip if its name ends with .gz."),
+        DEF_NOARGS(DirectedGraph, edges, "Return a read-only array (see numpy.asarray) with one row (tail, head) per edge."),
+        DEF_NOARGS(DirectedGraph, weights, "Return a read-only array with the stored weights, in the order of edges()."),
+        DEF_ARGS(DirectedGraph, assign_random_weights, "Store random weights in the range [min, max), integers if both ends are integers and floats otherwise."),
+        DEF_ARGS(DirectedGraph, assign_euclidean_weights, "Store as weights the distances between the endpoints of the edges, times scale (default 1), after build_geometric or build_grid."),
+        DEF_NOARGS(DirectedGraph, degrees, "Return a read-only array with the out-degree of each vertex."),
+        DEF_NOARGS(DirectedGraph, in_degrees, "Return a read-only array with the in-degree of each vertex."),
+        DEF_ARGS(DirectedGraph, load, "Replace the graph with the one in a file written by write, optionally with the label of the first vertex."),
+        DEF_ARGS(DirectedGraph, write_with_random_edges, "Write the graph with M more random edges to a file, using temporary files to save memory."),
+        DEF_ARGS(DirectedGraph, write_updates, "Write the graph and Q random insertions, removals and connectivity queries to a file, and the answers to the queries to another."),
         DEF_NOARGS(DirectedGraph, connect, "Make the graph connected."),
+        DEF_ARGS(DirectedGraph, track_components, "Keep the weakly connected components up to date as edges are added (or stop, if False)."),
+        DEF_NOARGS(DirectedGraph, component_count, "Return the number of weakly connected components."),
+        DEF_ARGS(DirectedGraph, same_component, "Tell whether two vertices are in the same weakly connected component."),
+        DEF_ARGS(DirectedGraph, fingerprint, "Return a hash of the graph as 32 hex digits, independent of the edge order; if invariant is True, also of the labels (optionally with the number of refinement rounds)."),
+        DEF_ARGS(DirectedGraph, verify, "Check properties such as \"simple,connected\" and optionally the number of edges, raising ValueError if one does not hold."),
         DEF_ARGS(DirectedGraph, build_forest, "Creates a forest with M edges."),
         DEF_ARGS(DirectedGraph, build_dag, "Creates a dag with M edges."),
+        DEF_ARGS(DirectedGraph, build_layered_dag, "Creates a dag with M edges between L layers, each reaching the next span ones (all if 0), optionally with random widths."),
         DEF_NOARGS(DirectedGraph, build_path, "Creates a path."),
         DEF_NOARGS(DirectedGraph, build_cycle, "Creates a cycle."),
         DEF_NOARGS(DirectedGraph, build_tree, "Creates a tree."),
         DEF_NOARGS(DirectedGraph, build_star, "Creates a star."),
         DEF_NOARGS(DirectedGraph, build_wheel, "Creates a wheel."),
         DEF_NOARGS(DirectedGraph, build_clique, "Creates a clique."),
+        DEF_ARGS(DirectedGraph, build_geometric, "Creates a random geometric graph with the given radius."),
+        DEF_ARGS(DirectedGraph, build_grid, "Creates a grid with the given rows and columns."),
         {NULL}
     };
 
+    NUMBER_METHODS(DirectedGraph)
+
     NEW_TYPE(DirectedGraph, "Directed graph")
 
     // Module initialization function
 
     PyMODINIT_FUNC initgraphgen(void) {
         PyObject* m;
+        // Needed to release the GIL during the generation
+        PyEval_InitThreads();
         m = Py_InitModule3(
             "graphgen",
             graphgen_methods,
@@ -635,6 +1630,10 @@ extern "C" {
         );
         ADD_OBJECT(m, RangeSampler)
         ADD_OBJECT(m, RangeSamplerIterator)
+        ADD_OBJECT(m, Future)
+        ArrayType.tp_as_buffer = &Array_as_buffer;
+        ArrayType.tp_flags |= Py_TPFLAGS_HAVE_NEWBUFFER;
+        ADD_OBJECT(m, Array)
         ADD_OBJECT(m, DisjointSet)
         ADD_OBJECT(m, UndirectedGraph)
         ADD_OBJECT(m, DirectedGraph)
@@ -1,13 +1,44 @@
 #include <vector>
 #include <algorithm>
-#include <exception>
 #include <iostream>
 #include <functional>
 #include <sstream>
 #include <numeric>
+#include <limits>
 #include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <deque>
+#include <future>
+#include <queue>
+#include <memory>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
 #include "cpp-btree/btree_set.h"
 
+#ifdef __unix__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef GRAPHGEN_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GRAPHGEN_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
 typedef size_t vertex_t;
 typedef struct{vertex_t tail, head;} edge_t;
 
@@ -30,6 +61,12 @@ class TooFewEdgesException: public std::exception {
     }
 };
 
+class TooManyNodesException: public std::exception {
+    virtual const char* what() const noexcept{
+        return "You specified too many nodes!";
+    }
+};
+
 class TooFewNodesException: public std::exception {
     virtual const char* what() const noexcept{
         return "You specified too few nodes!";
@@ -48,10 +85,325 @@ class NotImplementedException: public std::exception {
     }
 };
 
+class NoSuchEdgeException: public std::exception {
+    virtual const char* what() const noexcept {
+        return "The edge is not in the graph!";
+    }
+};
+
+class NoSuchVertexException: public std::exception {
+    virtual const char* what() const noexcept {
+        return "The vertex is not in the graph!";
+    }
+};
+
+class NoWeightsException: public std::exception {
+    virtual const char* what() const noexcept {
+        return "The graph has no stored weights!";
+    }
+};
+
+class NoPointsException: public std::exception {
+    virtual const char* what() const noexcept {
+        return "The graph has no coordinates for its vertices!";
+    }
+};
+
+class IOException: public std::exception {
+    virtual const char* what() const noexcept {
+        return "An error happened while reading or writing a file!";
+    }
+};
+
+class CompressionException: public std::exception {
+    virtual const char* what() const noexcept {
+        return "An error happened while compressing the output!";
+    }
+};
+
+class VerificationException: public std::exception {
+private:
+    std::string message;
+
+public:
+    VerificationException(const std::string& message): message(message) {}
+
+    virtual const char* what() const noexcept {
+        return message.c_str();
+    }
+};
+
+class ParseException: public std::exception {
+private:
+    std::string message;
+
+public:
+    ParseException(const std::string& message): message(message) {}
+
+    virtual const char* what() const noexcept {
+        return message.c_str();
+    }
+};
+
+/**
+ *  Instrumentation of the hot paths of the library. The phases below are
+ *  timed, and the counters updated, only if GRAPHGEN_STATS is defined;
+ *  otherwise the macros expand to nothing. Each thread accumulates its
+ *  numbers in its own slot, and get() sums all the slots. The times of
+ *  nested phases are included in the ones of the outer phases.
+ *
+ *  If tracing is enabled, every timed phase is also recorded as an event,
+ *  and write_trace writes them in the Chrome trace format (open it with
+ *  chrome://tracing or Perfetto).
+ */
+namespace stats {
+    enum phase_t {
+        SAMPLE,         // RangeSampler
+        SORT,           // sorting of keys and samples
+        INSERT,         // insertion in the edge store
+        RANK_INDEX,     // construction of the rank index
+        CONNECT,
+        SHUFFLE,
+        FORMAT,         // formatting of the output
+        WRITE,          // writing of the formatted output to the stream
+        VERIFY,
+        PARSE,          // parsing of graph files
+        PHASES_NO
+    };
+
+    enum counter_t {
+        EDGES_INSERTED,
+        DUPLICATES_REJECTED,
+        BYTES_WRITTEN,
+        PEAK_EDGE_STORE_BYTES,  // estimated from the number of keys
+        COUNTERS_NO
+    };
+
+    const char* phase_name(const phase_t p) {
+        static const char* names[PHASES_NO] = {
+            "sample", "sort", "insert", "rank_index",
+            "connect", "shuffle", "format", "write", "verify", "parse"
+        };
+        return names[p];
+    }
+
+    const char* counter_name(const counter_t c) {
+        static const char* names[COUNTERS_NO] = {
+            "edges_inserted", "duplicates_rejected",
+            "bytes_written", "peak_edge_store_bytes"
+        };
+        return names[c];
+    }
+
+    struct Stats {
+        double seconds[PHASES_NO];
+        uint64_t calls[PHASES_NO];
+        uint64_t counters[COUNTERS_NO];
+    };
+
+    struct TraceEvent {
+        phase_t phase;
+        uint64_t start_us, duration_us;
+    };
+
+    /**
+     *  The numbers of one thread. They are only written by their thread,
+     *  and are atomic so that get() can read them at any time.
+     */
+    struct Slot {
+        std::atomic<uint64_t> ns[PHASES_NO];
+        std::atomic<uint64_t> calls[PHASES_NO];
+        std::atomic<uint64_t> counters[COUNTERS_NO];
+        std::vector<TraceEvent> events;
+        size_t thread_id;
+
+        Slot(const size_t thread_id): thread_id(thread_id) {
+            clear();
+        }
+
+        void clear() {
+            for (size_t i = 0; i < PHASES_NO; i++) ns[i] = calls[i] = 0;
+            for (size_t i = 0; i < COUNTERS_NO; i++) counters[i] = 0;
+            events.clear();
+        }
+    };
+
+    // The slots of the running threads. When a thread exits, its numbers
+    // are added to retired and its trace events moved to retired_events,
+    // with its thread id, and its slot is freed.
+    std::mutex slots_mutex;
+    std::vector<Slot*> slots;
+    Slot retired(0);
+    std::vector<std::pair<size_t, TraceEvent>> retired_events;
+    size_t next_thread_id = 0;
+    std::atomic<bool> tracing(false);
+    const auto epoch = std::chrono::steady_clock::now();
+
+    /**
+     *  Owns the slot of a thread, and retires it when the thread exits
+     */
+    struct SlotHolder {
+        Slot* slot = nullptr;
+
+        ~SlotHolder() {
+            if (!slot) return;
+            std::lock_guard<std::mutex> lock(slots_mutex);
+            for (size_t i = 0; i < PHASES_NO; i++) {
+                retired.ns[i] += slot->ns[i];
+                retired.calls[i] += slot->calls[i];
+            }
+            for (size_t i = 0; i < COUNTERS_NO; i++) {
+                if (i == PEAK_EDGE_STORE_BYTES)
+                    retired.counters[i] = std::max<uint64_t>(retired.counters[i], slot->counters[i]);
+                else
+                    retired.counters[i] += slot->counters[i];
+            }
+            for (const TraceEvent& e: slot->events)
+                retired_events.push_back({slot->thread_id, e});
+            slots.erase(std::find(slots.begin(), slots.end(), slot));
+            delete slot;
+        }
+    };
+
+    Slot& slot() {
+        static thread_local SlotHolder holder;
+        if (!holder.slot) {
+            std::lock_guard<std::mutex> lock(slots_mutex);
+            holder.slot = new Slot(next_thread_id++);
+            slots.push_back(holder.slot);
+        }
+        return *holder.slot;
+    }
+
+    uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch
+        ).count();
+    }
+
+    void count(const counter_t c, const uint64_t n) {
+        std::atomic<uint64_t>& v = slot().counters[c];
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void update_max(const counter_t c, const uint64_t n) {
+        std::atomic<uint64_t>& v = slot().counters[c];
+        if (n > v.load(std::memory_order_relaxed))
+            v.store(n, std::memory_order_relaxed);
+    }
+
+    /**
+     *  Times a phase from its construction to its destruction
+     */
+    class ScopedPhase {
+    private:
+        phase_t phase;
+        uint64_t start;
+
+    public:
+        ScopedPhase(const phase_t phase): phase(phase), start(now_ns()) {}
+
+        ~ScopedPhase() {
+            uint64_t duration = now_ns() - start;
+            Slot& s = slot();
+            s.ns[phase].store(s.ns[phase].load(std::memory_order_relaxed) + duration,
+                              std::memory_order_relaxed);
+            s.calls[phase].store(s.calls[phase].load(std::memory_order_relaxed) + 1,
+                                 std::memory_order_relaxed);
+            if (tracing.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(slots_mutex);
+                s.events.push_back({phase, start / 1000, duration / 1000});
+            }
+        }
+    };
+
+    /**
+     *  Returns the sum of the numbers of all the threads, including those
+     *  that have exited. The peak counters are combined by taking the
+     *  maximum.
+     */
+    Stats get() {
+        Stats res = Stats();
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        std::vector<Slot*> all(slots);
+        all.push_back(&retired);
+        for (Slot* s: all) {
+            for (size_t i = 0; i < PHASES_NO; i++) {
+                res.seconds[i] += s->ns[i] * 1e-9;
+                res.calls[i] += s->calls[i];
+            }
+            for (size_t i = 0; i < COUNTERS_NO; i++) {
+                if (i == PEAK_EDGE_STORE_BYTES)
+                    res.counters[i] = std::max<uint64_t>(res.counters[i], s->counters[i]);
+                else
+                    res.counters[i] += s->counters[i];
+            }
+        }
+        return res;
+    }
+
+    /**
+     *  Sets all the numbers to zero and drops the trace events. It should
+     *  not be called while other threads are generating graphs.
+     */
+    void reset() {
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        for (Slot* s: slots)
+            s->clear();
+        retired.clear();
+        retired_events.clear();
+    }
+
+    void start_trace() {
+        tracing = true;
+    }
+
+    void stop_trace() {
+        tracing = false;
+    }
+
+    /**
+     *  Writes the recorded events as a Chrome trace
+     */
+    void write_trace(std::ostream& os) {
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        os << "{\"traceEvents\":[";
+        bool first = true;
+        auto write_event = [&](const TraceEvent& e, const size_t thread_id) {
+            os << (first ? "\n" : ",\n");
+            first = false;
+            os << "{\"name\":\"" << phase_name(e.phase) << "\",\"ph\":\"X\","
+               << "\"ts\":" << e.start_us << ",\"dur\":" << e.duration_us << ","
+               << "\"pid\":1,\"tid\":" << thread_id << "}";
+        };
+        for (const std::pair<size_t, TraceEvent>& e: retired_events)
+            write_event(e.second, e.first);
+        for (Slot* s: slots)
+            for (const TraceEvent& e: s->events)
+                write_event(e, s->thread_id);
+        os << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+}
+
+#ifdef GRAPHGEN_STATS
+#define GRAPHGEN_CONCAT_(a, b) a ## b
+#define GRAPHGEN_CONCAT(a, b) GRAPHGEN_CONCAT_(a, b)
+#define GRAPHGEN_PHASE(phase) \
+    stats::ScopedPhase GRAPHGEN_CONCAT(graphgen_phase_, __LINE__)(stats::phase)
+#define GRAPHGEN_COUNT(counter, n) stats::count(stats::counter, n)
+#define GRAPHGEN_MAX(counter, n) stats::update_max(stats::counter, n)
+#else
+#define GRAPHGEN_PHASE(phase) do {} while (0)
+#define GRAPHGEN_COUNT(counter, n) do {} while (0)
+#define GRAPHGEN_MAX(counter, n) do {} while (0)
+#endif
+
 namespace Random {
     uint64_t rand_max = std::numeric_limits<uint64_t>::max();
-    uint64_t x = 8867512362436069LL;
-    uint64_t w;
+    // Every thread has its own state, so that graphs can be generated in
+    // parallel without races and with reproducible results.
+    thread_local uint64_t x = 8867512362436069LL;
+    thread_local uint64_t w;
 
     /**
      *  Simple 64-bit variant of the XorShift random number algorithm.
@@ -63,11 +415,25 @@ namespace Random {
         return w = w ^ (w >> 19) ^ (t ^ (t >> 8));
     }
 
+    /**
+     *  Seeds the generator of the calling thread, resetting its whole
+     *  state, so that the same seed always gives the same values.
+     */
     void srand(int S) {
+        x = 8867512362436069LL;
         w = S;
         ::srand(S);
     }
 
+    /**
+     *  Sets the whole state of the generator of the calling thread. It is
+     *  used to seed worker threads from a number drawn on the caller.
+     */
+    void seed(uint64_t s) {
+        x = s ^ 8867512362436069LL;
+        w = s + 1;
+    }
+
     template<typename T1, typename T2>
     auto randrange(T1 bottom, T2 top)
     -> typename std::enable_if<!std::is_integral<decltype(bottom+top) >::value,
@@ -81,344 +447,4318 @@ namespace Random {
                                decltype(bottom+top)>::type {
         return xor128() % (top - bottom) + bottom;
     }
-}
 
-namespace utils {
-    template<typename T>
-    void write_weight(
-        Weighter<T>& weighter,
-        const edge_t& edge,
-        std::ostream& os
-    ) {
-        os << " " << weighter(edge);
+    /**
+     *  Fisher-Yates shuffle using the generator of the calling thread,
+     *  unlike std::random_shuffle which uses the shared state of rand().
+     */
+    template<typename It>
+    void shuffle(It begin, It end) {
+        GRAPHGEN_PHASE(SHUFFLE);
+        for (size_t i = end - begin; i > 1; i--)
+            std::iter_swap(begin + (i-1), begin + randrange(size_t(0), i));
     }
 
-    template<>
-    void write_weight(Weighter<void>&, const edge_t&, std::ostream&) {}
-}
+    // Bulk generation. The fill functions below draw from eight xorshift
+    // generators at once, the lanes, seeded with SplitMix64 from a single
+    // value drawn from the generator of the calling thread. Value i of a
+    // fill always comes from lane i % 8: AVX2 only advances four lanes with
+    // each instruction, so the results are the same on every machine.
 
-/**
- *  Labeler is the abstract class that defines the interface for a
- *  graph labeler functor, i.e. a callable object that assigns labels to vertices.
- */
-template<typename T>
-class Labeler {
-public:
-    typedef T label_t;
+    const size_t lanes_no = 8;
 
-    virtual ~Labeler() {}
+    uint64_t splitmix64(uint64_t& s) {
+        uint64_t z = (s += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // The number of times the calling thread has forked its generator
+    thread_local uint64_t forks = 0;
 
     /**
-     *  label takes as argument the index of the node, and
-     *  returns a label of type T for it. It must be a deterministic
-     *  injective function.
+     *  Returns a seed for the generators of the chunks of a parallel
+     *  algorithm. It is derived from the state of the calling thread
+     *  without advancing it, so that the values drawn later by the caller
+     *  do not depend on the number of threads used.
      */
-    virtual T operator()(const vertex_t i) = 0;
-};
+    uint64_t fork_seed() {
+        uint64_t s = x ^ (w << 1) ^ (++forks * 0xbf58476d1ce4e5b9ULL);
+        return splitmix64(s);
+    }
 
-/**
- *  IotaLabeler is the simplest labeler. The label of the i-th vetex
- *  is simply the integer (i+start).
- */
-class IotaLabeler: public virtual Labeler<int> {
-private:
-    int start;
+    struct Lanes {
+        uint64_t x[lanes_no], w[lanes_no];
 
-public:
-    IotaLabeler(int start = 0): start(start) {}
-    ~IotaLabeler() {}
+        Lanes() {
+            uint64_t s = xor128();
+            for (size_t i = 0; i < lanes_no; i++) {
+                x[i] = splitmix64(s);
+                w[i] = splitmix64(s);
+            }
+        }
+    };
 
-    int operator()(const vertex_t i) override {
-        return start + i;
+    /**
+     *  Computes the 128-bit product of a and b
+     */
+    void mul128(const uint64_t a, const uint64_t b, uint64_t& hi, uint64_t& lo) {
+        uint64_t a0 = uint32_t(a), a1 = a >> 32, b0 = uint32_t(b), b1 = b >> 32;
+        uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+        uint64_t mid = (p00 >> 32) + uint32_t(p01) + uint32_t(p10);
+        hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+        lo = a * b;
     }
-};
-
-/**
- *  RandIntLabeler assigns random labels from a given range
- */
-class RandIntLabeler: public virtual Labeler<int> {
-private:
-    std::vector<int> labels;
 
-public:
     /**
-     *  Define the sample range [start, end)
+     *  Maps the random value r to [0, s) without bias, with Lemire's
+     *  multiply and shift: the few values that would be biased are redrawn
+     *  from the generator of the calling thread. Bounds up to 2^32 only use
+     *  the upper half of r, like the AVX2 code.
      */
-    RandIntLabeler(int start, int end) {
-        labels.resize(end - start);
-        std::iota(labels.begin(), labels.end(), start);
-        std::random_shuffle(labels.begin(), labels.end());
+    uint64_t reduce(const uint64_t r, const uint64_t s) {
+        if (s <= (uint64_t(1) << 32)) {
+            uint64_t m = (r >> 32) * s;
+            if (uint32_t(m) < s) {
+                uint32_t t = uint32_t(0 - s) % s;
+                while (uint32_t(m) < t)
+                    m = (xor128() >> 32) * s;
+            }
+            return m >> 32;
+        }
+        uint64_t hi, lo;
+        mul128(r, s, hi, lo);
+        if (lo < s) {
+            uint64_t t = (0 - s) % s;
+            while (lo < t)
+                mul128(xor128(), s, hi, lo);
+        }
+        return hi;
     }
-    ~RandIntLabeler() {}
 
-    int operator()(const vertex_t i) {
-        return labels.at(i);
+    /**
+     *  Fills out with lanes_no * blocks values from the lanes, each one
+     *  reduced to [0, bounds[i * stride]) unless bounds is null.
+     */
+    void fill_blocks_scalar(
+        Lanes& lanes, uint64_t* out, const size_t blocks,
+        const uint64_t* bounds, const size_t stride
+    ) {
+        // The state is kept in locals, since out could alias it
+        uint64_t x[lanes_no], w[lanes_no];
+        memcpy(x, lanes.x, sizeof(x));
+        memcpy(w, lanes.w, sizeof(w));
+        for (size_t b = 0; b < blocks; b++, out += lanes_no) {
+            for (size_t i = 0; i < lanes_no; i++) {
+                uint64_t t = x[i] ^ (x[i] << 11);
+                x[i] = w[i];
+                w[i] = w[i] ^ (w[i] >> 19) ^ (t ^ (t >> 8));
+            }
+            if (!bounds) {
+                memcpy(out, w, sizeof(w));
+                continue;
+            }
+            for (size_t i = 0; i < lanes_no; i++) {
+                uint64_t s = bounds[(lanes_no * b + i) * stride];
+                uint64_t m = (w[i] >> 32) * s;
+                // Same as reduce, without the call in the common case
+                out[i] = s <= (uint64_t(1) << 32) && uint32_t(m) >= s
+                    ? m >> 32 : reduce(w[i], s);
+            }
+        }
+        memcpy(lanes.x, x, sizeof(x));
+        memcpy(lanes.w, w, sizeof(w));
     }
-};
-
-/**
- *  StaticLabeler assigns labels from a given vector
- */
-template<typename T>
-class StaticLabeler: public Labeler<T> {
-private:
-    std::vector<T>& labels;
 
-public:
-    StaticLabeler(const std::vector<T>& labels): labels(labels) {}
-    ~StaticLabeler() {}
+#ifdef GRAPHGEN_HAVE_AVX2
+    __attribute__((target("avx2")))
+    inline __m256i xorshift_avx2(__m256i& x, __m256i& w) {
+        __m256i t = _mm256_xor_si256(x, _mm256_slli_epi64(x, 11));
+        x = w;
+        return w = _mm256_xor_si256(
+            _mm256_xor_si256(w, _mm256_srli_epi64(w, 19)),
+            _mm256_xor_si256(t, _mm256_srli_epi64(t, 8))
+        );
+    }
 
-    T operator()(const vertex_t i) {
-        return labels.at(i);
+    /**
+     *  Reduces the four values in r as reduce does, storing them in out
+     */
+    __attribute__((target("avx2")))
+    inline void reduce_avx2(__m256i r, const uint64_t* s, const size_t stride, uint64_t* out) {
+        const __m256i high = _mm256_set1_epi64x(int64_t(0xffffffff00000000ULL));
+        const __m256i low = _mm256_set1_epi64x(0xffffffff);
+        __m256i sv = stride == 0 ? _mm256_set1_epi64x(s[0]) : _mm256_setr_epi64x(
+            s[0], s[stride], s[2 * stride], s[3 * stride]
+        );
+        if (!_mm256_testz_si256(sv, high)) {
+            _mm256_storeu_si256((__m256i*) out, r);
+            for (size_t i = 0; i < 4; i++)
+                out[i] = reduce(out[i], s[i * stride]);
+            return;
+        }
+        __m256i m = _mm256_mul_epu32(_mm256_srli_epi64(r, 32), sv);
+        // The values whose low half is below the bound may be biased, and
+        // are left to reduce; both halves are below 2^32, so the signed
+        // comparison works
+        int biased = _mm256_movemask_pd(_mm256_castsi256_pd(
+            _mm256_cmpgt_epi64(sv, _mm256_and_si256(m, low))
+        ));
+        _mm256_storeu_si256((__m256i*) out, _mm256_srli_epi64(m, 32));
+        if (!biased) return;
+        uint64_t raw[4];
+        _mm256_storeu_si256((__m256i*) raw, r);
+        for (size_t i = 0; biased; i++, biased >>= 1)
+            if (biased & 1)
+                out[i] = reduce(raw[i], s[i * stride]);
     }
-};
 
-/**
- *  Weighter is the abstract class that defines the interface for a
- *  graph weighter functor, i.e. a callable object that assigns weights to edges.
- */
-template<typename T>
-class Weighter {
-public:
-    typedef T weight_t;
+    __attribute__((target("avx2")))
+    void fill_blocks_avx2(
+        Lanes& lanes, uint64_t* out, const size_t blocks,
+        const uint64_t* bounds, const size_t stride
+    ) {
+        __m256i x0 = _mm256_loadu_si256((const __m256i*) lanes.x);
+        __m256i x1 = _mm256_loadu_si256((const __m256i*) (lanes.x + 4));
+        __m256i w0 = _mm256_loadu_si256((const __m256i*) lanes.w);
+        __m256i w1 = _mm256_loadu_si256((const __m256i*) (lanes.w + 4));
+        for (size_t b = 0; b < blocks; b++, out += lanes_no) {
+            __m256i r0 = xorshift_avx2(x0, w0);
+            __m256i r1 = xorshift_avx2(x1, w1);
+            if (!bounds) {
+                _mm256_storeu_si256((__m256i*) out, r0);
+                _mm256_storeu_si256((__m256i*) (out + 4), r1);
+                continue;
+            }
+            const uint64_t* s = bounds + lanes_no * b * stride;
+            reduce_avx2(r0, s, stride, out);
+            reduce_avx2(r1, s + 4 * stride, stride, out + 4);
+        }
+        _mm256_storeu_si256((__m256i*) lanes.x, x0);
+        _mm256_storeu_si256((__m256i*) (lanes.x + 4), x1);
+        _mm256_storeu_si256((__m256i*) lanes.w, w0);
+        _mm256_storeu_si256((__m256i*) (lanes.w + 4), w1);
+    }
+#endif
 
-    virtual ~Weighter() {}
+    bool has_avx2() {
+#ifdef GRAPHGEN_HAVE_AVX2
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
 
     /**
-     *  takes as arguments two vertex_t, corresponding to the tail and
-     *  the head vertices of the edge of interest, and returns a weight
-     *  of type T for the edge. It must be a deterministic function.
+     *  Tells whether the fill functions use AVX2, which is detected at run
+     *  time. Turning it off does not change the values generated.
      */
-    virtual T operator()(const edge_t& edge) = 0;
-};
+    bool use_avx2 = has_avx2();
 
-// TODO (?) Euclidean weights generator
+    /**
+     *  Fills out with n values from the lanes, reduced as in
+     *  fill_blocks_scalar
+     */
+    void fill_lanes(
+        Lanes& lanes, uint64_t* out, const size_t n,
+        const uint64_t* bounds, const size_t stride
+    ) {
+        const size_t blocks = n / lanes_no, done = blocks * lanes_no;
+#ifdef GRAPHGEN_HAVE_AVX2
+        if (use_avx2)
+            fill_blocks_avx2(lanes, out, blocks, bounds, stride);
+        else
+#endif
+        fill_blocks_scalar(lanes, out, blocks, bounds, stride);
+        if (done == n) return;
+        uint64_t last[lanes_no];
+        fill_blocks_scalar(lanes, last, 1, nullptr, 0);
+        for (size_t i = done; i < n; i++)
+            out[i] = bounds ? reduce(last[i - done], bounds[i * stride]) : last[i - done];
+    }
 
-/**
- *  RandomWeighter is the simplest weighter. It returns random weights taken
- *  from a given range of values
- */
-template<typename T>
-class RandomWeighter: public Weighter<T> {
-private:
-    T min, max; // Define the range
+    // The values are generated in chunks of this size
+    const size_t fill_chunk = 1024;
 
-public:
-    RandomWeighter(T min, T max): min(min), max(max) {};
-    ~RandomWeighter() {};
+    /**
+     *  Fills out[0, n) with uniform random values in [bottom, top), much
+     *  faster than calling randrange n times.
+     */
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type
+    fill(T* out, const size_t n, const T bottom, const T top) {
+        if (n == 0) return;
+        const uint64_t range = uint64_t(top) - uint64_t(bottom);
+        Lanes lanes;
+        uint64_t buf[fill_chunk];
+        for (size_t i = 0; i < n; i += fill_chunk) {
+            size_t len = std::min(fill_chunk, n - i);
+            fill_lanes(lanes, buf, len, &range, 0);
+            for (size_t j = 0; j < len; j++)
+                out[i + j] = T(uint64_t(bottom) + buf[j]);
+        }
+    }
 
-    T operator()(const edge_t&) {
-        return randrange(min, max);
+    template<typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type
+    fill(T* out, const size_t n, const T bottom, const T top) {
+        if (n == 0) return;
+        Lanes lanes;
+        uint64_t buf[fill_chunk];
+        for (size_t i = 0; i < n; i += fill_chunk) {
+            size_t len = std::min(fill_chunk, n - i);
+            fill_lanes(lanes, buf, len, nullptr, 0);
+            for (size_t j = 0; j < len; j++) {
+                // 52 random bits as the mantissa of a double in [1, 2)
+                uint64_t bits = buf[j] >> 12 | 0x3ff0000000000000ULL;
+                double u;
+                memcpy(&u, &bits, sizeof(u));
+                out[i + j] = T(bottom + (u - 1.0) * (top - bottom));
+            }
+        }
     }
-};
 
-/**
- *  NoWeighter is a dummy weighter. It throws if called
- */
+    /**
+     *  Fills out[i] with a uniform random integer in [0, bounds[i]), for
+     *  every i < n. The bounds must be positive; out can be bounds itself.
+     */
+    template<typename T>
+    void fill_below(T* out, const T* bounds, const size_t n) {
+        if (n == 0) return;
+        Lanes lanes;
+        uint64_t buf[fill_chunk], s[fill_chunk];
+        for (size_t i = 0; i < n; i += fill_chunk) {
+            size_t len = std::min(fill_chunk, n - i);
+            for (size_t j = 0; j < len; j++)
+                s[j] = uint64_t(bounds[i + j]);
+            fill_lanes(lanes, buf, len, s, 1);
+            for (size_t j = 0; j < len; j++)
+                out[i + j] = T(buf[j]);
+        }
+    }
+}
+
+namespace utils {
+    /**
+     *  Appends the decimal representation of an integer to out. The digits
+     *  are produced two at a time from a lookup table, which is much faster
+     *  than going through an ostream.
+     */
+    template<typename T>
+    typename std::enable_if<std::is_integral<T>::value && (sizeof(T) > 1)>::type
+    append_value(std::string& out, const T value) {
+        static const char digits[] =
+            "0001020304050607080910111213141516171819"
+            "2021222324252627282930313233343536373839"
+            "4041424344454647484950515253545556575859"
+            "6061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        char buf[24];
+        char* end = buf + sizeof(buf);
+        char* p = end;
+        bool negative = value < 0;
+        uint64_t u = negative ? 0 - uint64_t(value) : uint64_t(value);
+        while (u >= 100) {
+            size_t i = (u % 100) * 2;
+            u /= 100;
+            *--p = digits[i + 1];
+            *--p = digits[i];
+        }
+        if (u >= 10) {
+            *--p = digits[u * 2 + 1];
+            *--p = digits[u * 2];
+        } else {
+            *--p = '0' + u;
+        }
+        if (negative) *--p = '-';
+        out.append(p, end - p);
+    }
+
+    /**
+     *  Appends any other value to out, formatted as an ostream would do.
+     */
+    template<typename T>
+    typename std::enable_if<!(std::is_integral<T>::value && (sizeof(T) > 1))>::type
+    append_value(std::string& out, const T& value) {
+        std::ostringstream oss;
+        oss << value;
+        out += oss.str();
+    }
+
+    /**
+     *  Hashes a string of n bytes with FNV-1a
+     */
+    uint64_t hash_text(const char* p, const size_t n) {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < n; i++) {
+            h ^= uint8_t(p[i]);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+
+    /**
+     *  WeightColumn stores the weights of the edges of a graph, as an array
+     *  of keys of the edges, sorted, and an array of weights aligned with
+     *  it: the weight of the edge with key keys[i] is values[i].
+     */
+    template<typename K, typename T>
+    struct WeightColumn {
+        std::vector<K> keys;
+        std::vector<T> values;
+
+        bool empty() const {
+            return keys.empty();
+        }
+
+        void clear() {
+            std::vector<K>().swap(keys);
+            std::vector<T>().swap(values);
+        }
+
+        /**
+         *  Returns the position of the given key, or keys.size() if the
+         *  key is not in the column
+         */
+        size_t find(const K key) const {
+            auto it = std::lower_bound(keys.begin(), keys.end(), key);
+            if (it == keys.end() || *it != key) return keys.size();
+            return it - keys.begin();
+        }
+
+        /**
+         *  Returns the hashes of the weights, as hash_text of the way they
+         *  are written in the output
+         */
+        std::vector<uint64_t> hash_values() const {
+            std::vector<uint64_t> res(values.size());
+            std::string text;
+            for (size_t i = 0; i < values.size(); i++) {
+                text.clear();
+                append_value(text, values[i]);
+                res[i] = hash_text(text.data(), text.size());
+            }
+            return res;
+        }
+    };
+
+    template<typename K>
+    struct WeightColumn<K, void> {
+        // Always empty: there are no weights to store
+        std::vector<K> keys;
+
+        bool empty() const {
+            return true;
+        }
+
+        void clear() {}
+
+        size_t find(const K) const {
+            return 0;
+        }
+
+        std::vector<uint64_t> hash_values() const {
+            return std::vector<uint64_t>();
+        }
+    };
+
+    /**
+     *  WeightBlock holds the weights of a block of edges that is being
+     *  written. It does nothing if the graph has no weights.
+     */
+    template<typename T>
+    struct WeightBlock {
+        std::vector<T> weights;
+
+        void compute(Weighter<T>& weighter, const std::vector<edge_t>& edges) {
+            weights.resize(edges.size());
+            weighter(edges.data(), edges.size(), weights.data());
+        }
+
+        /**
+         *  Takes the weights of n edges from a column, where order gives
+         *  the position of each edge in the column
+         */
+        template<typename K>
+        void copy(const WeightColumn<K, T>& column, const size_t* order, const size_t n) {
+            weights.resize(n);
+            for (size_t i = 0; i < n; i++)
+                weights[i] = column.values[order[i]];
+        }
+
+        void append(std::string& out, const size_t i) const {
+            out += ' ';
+            append_value(out, weights[i]);
+        }
+    };
+
+    template<>
+    struct WeightBlock<void> {
+        void compute(Weighter<void>&, const std::vector<edge_t>&) {}
+
+        template<typename K>
+        void copy(const WeightColumn<K, void>&, const size_t*, const size_t) {}
+
+        void append(std::string&, const size_t) const {}
+    };
+
+    // The number of threads used by parallel algorithms started from the
+    // calling thread; 0 means one per available core.
+    thread_local size_t max_threads = 0;
+
+    /**
+     *  An Executor runs the chunks of parallel_for. When none is set, a new
+     *  thread is started for each chunk; a thread pool can set itself as
+     *  the executor of its workers, so that the chunks of their parallel
+     *  algorithms are run by the pool instead.
+     */
+    class Executor {
+    public:
+        virtual ~Executor() {}
+
+        /**
+         *  Runs all the given tasks, and returns when they are all done
+         */
+        virtual void run_all(std::vector<std::function<void()>>& tasks) = 0;
+    };
+
+    thread_local Executor* executor = nullptr;
+
+    size_t threads_no() {
+        if (max_threads > 0) return max_threads;
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    /**
+     *  Splits the range [0, n) in contiguous chunks of at least grain
+     *  elements, and calls f(begin, end) on each of them, using all the
+     *  available cores.
+     *
+     *  When the range is split, every chunk draws from its own generator,
+     *  seeded from the state of the caller, whose generator is left as it
+     *  was. The values drawn by f depend on the seed, but also on how the
+     *  range is split: code whose results must not depend on the number of
+     *  threads must not draw from Random inside f.
+     */
+    template<typename F>
+    void parallel_for(const size_t n, F f, const size_t grain = 1 << 14) {
+        size_t chunks = std::min(threads_no(), (n + grain - 1) / grain);
+        if (chunks <= 1) {
+            if (n > 0) f(size_t(0), n);
+            return;
+        }
+        const uint64_t seed = Random::fork_seed();
+        // Runs chunk i with its own generator, and then restores the one
+        // of the thread, which can be the caller or a worker of a pool
+        auto run = [&f, seed, n, chunks](size_t i) {
+            const uint64_t x = Random::x, w = Random::w;
+            uint64_t s = seed + i;
+            Random::seed(Random::splitmix64(s));
+            try {
+                f(n * i / chunks, n * (i+1) / chunks);
+            } catch (...) {
+                Random::x = x, Random::w = w;
+                throw;
+            }
+            Random::x = x, Random::w = w;
+        };
+        if (executor) {
+            std::vector<std::function<void()>> tasks;
+            for (size_t i = 0; i < chunks; i++)
+                tasks.push_back([&run, i]() { run(i); });
+            executor->run_all(tasks);
+            return;
+        }
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < chunks; i++)
+            threads.emplace_back(run, i);
+        run(0);
+        for (auto& t: threads)
+            t.join();
+    }
+
+    /**
+     *  Runs a pipeline of blocks_no blocks. For each block, in order,
+     *  prepare(i) is called on the calling thread; then produce(i) is called
+     *  on any of the worker threads, and finally consume(i) is called on the
+     *  calling thread, again in order. At most window blocks are in flight
+     *  at any time, so that their buffers can be reused. If any of the
+     *  callbacks throws, the pipeline is stopped and the exception is
+     *  rethrown on the calling thread.
+     *
+     *  @param workers  the number of worker threads; if it is zero, all the
+     *                  work is done by the calling thread
+     */
+    template<typename P, typename R, typename C>
+    void ordered_pipeline(
+        const size_t blocks_no,
+        P prepare,
+        R produce,
+        C consume,
+        const size_t workers,
+        const size_t window
+    ) {
+        if (workers == 0) {
+            for (size_t i = 0; i < blocks_no; i++) {
+                prepare(i);
+                produce(i);
+                consume(i);
+            }
+            return;
+        }
+
+        std::mutex mutex;
+        std::condition_variable prepared_cv, produced_cv;
+        size_t prepared = 0, taken = 0;
+        std::vector<char> produced(window, false);
+        std::exception_ptr error;
+
+        auto worker = [&]() {
+            while (true) {
+                size_t i;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    prepared_cv.wait(lock, [&]() {
+                        return taken < prepared || taken == blocks_no;
+                    });
+                    if (taken == blocks_no) return;
+                    i = taken++;
+                }
+                try {
+                    produce(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) error = std::current_exception();
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    produced[i % window] = true;
+                }
+                produced_cv.notify_all();
+            }
+        };
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < workers; t++)
+            threads.emplace_back(worker);
+
+        try {
+            for (size_t i = 0; i < blocks_no; i++) {
+                while (prepared < blocks_no && prepared < i + window) {
+                    prepare(prepared);
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        prepared++;
+                    }
+                    prepared_cv.notify_one();
+                }
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    produced_cv.wait(lock, [&]() {
+                        return bool(produced[i % window]);
+                    });
+                    produced[i % window] = false;
+                    if (error) std::rethrow_exception(error);
+                }
+                consume(i);
+            }
+        } catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                taken = blocks_no;
+            }
+            prepared_cv.notify_all();
+            for (auto& t: threads)
+                t.join();
+            throw;
+        }
+        prepared_cv.notify_all();
+        for (auto& t: threads)
+            t.join();
+    }
+
+    /**
+     *  A fixed set of worker threads that run the tasks submitted to it,
+     *  starting them in order of submission. submit returns a future that becomes ready when
+     *  the task is done, and rethrows the exceptions thrown by the task.
+     */
+    class ThreadPool {
+    private:
+        std::vector<std::thread> threads;
+        std::queue<std::packaged_task<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool stopping;
+
+        void work() {
+            while (true) {
+                std::packaged_task<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&]() { return stopping || !tasks.empty(); });
+                    if (tasks.empty()) return;
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        }
+
+    public:
+        explicit ThreadPool(const size_t threads_no): stopping(false) {
+            for (size_t i = 0; i < threads_no; i++)
+                threads.emplace_back(&ThreadPool::work, this);
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         *  Waits for all the submitted tasks to be done
+         */
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            cv.notify_all();
+            for (auto& t: threads)
+                t.join();
+        }
+
+        std::future<void> submit(std::function<void()> f) {
+            std::packaged_task<void()> task(f);
+            std::future<void> res = task.get_future();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.push(std::move(task));
+            }
+            cv.notify_one();
+            return res;
+        }
+    };
+
+    /**
+     *  The pool used for background generation, with one thread per core.
+     *  It is created the first time it is needed.
+     */
+    ThreadPool& background_pool() {
+        static ThreadPool pool(threads_no());
+        return pool;
+    }
+
+    /**
+     *  Arena is a monotonic allocator: memory is taken from large chunks by
+     *  bumping a pointer, and the chunks are only given back all together,
+     *  when the arena is destroyed or released, or the unused ones when it
+     *  is trimmed. Freed blocks are kept in free lists, one per block size,
+     *  and reused by later allocations of the same size, which is what the
+     *  nodes of the edge store need.
+     *
+     *  The chunks start small and double in size up to chunk_size, so an
+     *  arena holding a few edges takes a few kilobytes. Chunks of at least
+     *  2MB are aligned to 2MB and, on Linux, marked as candidates for
+     *  transparent huge pages. An arena is not thread-safe.
+     */
+    class Arena {
+    private:
+        struct Chunk {
+            char* data;
+            size_t size;
+        };
+
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        enum: size_t {
+            alignment = 16,
+            huge_page = size_t(1) << 21
+        };
+
+        std::vector<Chunk> chunks;
+        // The chunk being filled, and the first free byte in it
+        size_t current;
+        size_t offset;
+        // The largest size of a chunk, and the sizes of the first and of
+        // the next one
+        size_t chunk_size;
+        size_t first_chunk;
+        size_t next_chunk;
+        // Free lists, as pairs (block size, first block)
+        std::vector<std::pair<size_t, FreeBlock*>> free_lists;
+
+        static char* allocate_chunk(const size_t size) {
+            void* p = nullptr;
+            if (size < huge_page) {
+                p = std::malloc(size);
+                if (!p) throw std::bad_alloc();
+                return (char*) p;
+            }
+#ifdef __unix__
+            if (posix_memalign(&p, huge_page, size) != 0)
+                throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+            madvise(p, size, MADV_HUGEPAGE);
+#endif
+#else
+            p = std::malloc(size);
+            if (!p) throw std::bad_alloc();
+#endif
+            return (char*) p;
+        }
+
+        // Returns the index of the chunk holding p, or chunks.size()
+        size_t chunk_of(const void* p) const {
+            const char* c = (const char*) p;
+            for (size_t i = 0; i < chunks.size(); i++)
+                if (c >= chunks[i].data && c < chunks[i].data + chunks[i].size)
+                    return i;
+            return chunks.size();
+        }
+
+        // Keeps in the free lists only the blocks b of the given size for
+        // which keep(b, size) is true
+        template<typename F>
+        void filter_free_lists(F keep) {
+            for (auto& l: free_lists) {
+                FreeBlock** link = &l.second;
+                while (*link) {
+                    if (keep(*link, l.first))
+                        link = &(*link)->next;
+                    else
+                        *link = (*link)->next;
+                }
+            }
+        }
+
+        FreeBlock*& free_list(const size_t size) {
+            for (auto& l: free_lists)
+                if (l.first == size)
+                    return l.second;
+            free_lists.emplace_back(size, nullptr);
+            return free_lists.back().second;
+        }
+
+    public:
+        /**
+         *  @param chunk_size   the largest size of the chunks, rounded up
+         *                      to a multiple of 2MB
+         *  @param first_chunk  the size of the first chunk
+         */
+        explicit Arena(const size_t chunk_size = huge_page, const size_t first_chunk = 1 << 12):
+            current(0), offset(0),
+            chunk_size((chunk_size + huge_page - 1) / huge_page * huge_page),
+            first_chunk(std::min<size_t>(std::max<size_t>(first_chunk, alignment), this->chunk_size)),
+            next_chunk(this->first_chunk) {}
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        ~Arena() {
+            release();
+        }
+
+        void* allocate(size_t size) {
+            size = std::max<size_t>((size + alignment - 1) / alignment * alignment, alignment);
+            FreeBlock*& head = free_list(size);
+            if (head) {
+                FreeBlock* block = head;
+                head = block->next;
+                return block;
+            }
+            while (current < chunks.size() && offset + size > chunks[current].size) {
+                current++;
+                offset = 0;
+            }
+            if (current == chunks.size()) {
+                size_t bytes = std::max(next_chunk, size);
+                if (bytes >= huge_page)
+                    bytes = (bytes + huge_page - 1) / huge_page * huge_page;
+                chunks.push_back({allocate_chunk(bytes), bytes});
+                next_chunk = std::min(2 * next_chunk, chunk_size);
+                offset = 0;
+            }
+            void* res = chunks[current].data + offset;
+            offset += size;
+            return res;
+        }
+
+        void deallocate(void* p, size_t size) {
+            size = std::max<size_t>((size + alignment - 1) / alignment * alignment, alignment);
+            FreeBlock* block = (FreeBlock*) p;
+            FreeBlock*& head = free_list(size);
+            block->next = head;
+            head = block;
+        }
+
+        /**
+         *  A position in the arena, see rewind
+         */
+        struct Mark {
+            size_t chunk, offset;
+        };
+
+        Mark mark() const {
+            return {current, offset};
+        }
+
+        /**
+         *  Frees everything allocated after the given mark at once. The
+         *  chunks are kept, so allocating again does not touch the heap,
+         *  and so are the freed blocks that lie before the mark.
+         */
+        void rewind(const Mark& m) {
+            filter_free_lists([&](FreeBlock* b, const size_t size) {
+                size_t c = chunk_of(b);
+                return c < m.chunk ||
+                       (c == m.chunk && (char*) b - chunks[c].data + size <= m.offset);
+            });
+            current = m.chunk;
+            offset = m.offset;
+        }
+
+        /**
+         *  Gives back to the system the chunks that are not in use, from the
+         *  last one, until the arena takes at most max_capacity bytes. The
+         *  blocks in the free lists do not count as in use.
+         */
+        void trim(const size_t max_capacity) {
+            size_t total = capacity();
+            size_t used = std::min(current + (offset > 0), chunks.size());
+            size_t keep = chunks.size();
+            while (keep > used && total > max_capacity)
+                total -= chunks[--keep].size;
+            if (keep == chunks.size())
+                return;
+            filter_free_lists([&](FreeBlock* b, const size_t) {
+                return chunk_of(b) < keep;
+            });
+            for (size_t i = keep; i < chunks.size(); i++)
+                std::free(chunks[i].data);
+            chunks.resize(keep);
+            next_chunk = chunks.empty() ? first_chunk :
+                         std::min(2 * chunks.back().size, chunk_size);
+        }
+
+        /**
+         *  Gives all the chunks back to the system
+         */
+        void release() {
+            for (Chunk& c: chunks)
+                std::free(c.data);
+            chunks.clear();
+            free_lists.clear();
+            current = offset = 0;
+            next_chunk = first_chunk;
+        }
+
+        /**
+         *  The number of bytes taken from the system
+         */
+        size_t capacity() const {
+            size_t res = 0;
+            for (const Chunk& c: chunks)
+                res += c.size;
+            return res;
+        }
+    };
+
+    /**
+     *  A standard allocator that takes its memory from an Arena. Without an
+     *  arena, it uses the heap like std::allocator. An allocator created
+     *  with ArenaAllocator::owning creates its own arena, which is freed
+     *  when the allocator and all its copies are destroyed: a graph using
+     *  it gives back the memory of its edges in bulk when it is destroyed.
+     */
+    template<typename T>
+    class ArenaAllocator {
+    private:
+        template<typename U> friend class ArenaAllocator;
+
+        Arena* arena;
+        std::shared_ptr<Arena> owner;
+
+    public:
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        template<typename U>
+        struct rebind {
+            typedef ArenaAllocator<U> other;
+        };
+
+        ArenaAllocator(Arena* arena = nullptr): arena(arena) {}
+
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other):
+            arena(other.arena), owner(other.owner) {}
+
+        static ArenaAllocator owning(const size_t chunk_size = size_t(1) << 21) {
+            ArenaAllocator res;
+            res.owner = std::make_shared<Arena>(chunk_size);
+            res.arena = res.owner.get();
+            return res;
+        }
+
+        Arena* get_arena() const {
+            return arena;
+        }
+
+        T* allocate(const size_t n, const void* = nullptr) {
+            if (!arena)
+                return static_cast<T*>(::operator new(n * sizeof(T)));
+            return static_cast<T*>(arena->allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, const size_t n) {
+            if (!arena)
+                ::operator delete(p);
+            else
+                arena->deallocate(p, n * sizeof(T));
+        }
+
+        size_t max_size() const {
+            return std::numeric_limits<size_t>::max() / sizeof(T);
+        }
+
+        template<typename U, typename... Args>
+        void construct(U* p, Args&&... args) {
+            ::new((void*) p) U(std::forward<Args>(args)...);
+        }
+
+        template<typename U>
+        void destroy(U* p) {
+            p->~U();
+        }
+
+        template<typename U>
+        bool operator==(const ArenaAllocator<U>& other) const {
+            return arena == other.arena;
+        }
+
+        template<typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const {
+            return arena != other.arena;
+        }
+    };
+
+    /**
+     *  The arena for the temporary buffers of the calling thread. It is
+     *  used through ScratchScope, so that the buffers of an operation are
+     *  freed all together when it ends, and its chunks are reused by the
+     *  next operations.
+     */
+    Arena& scratch_arena() {
+        static thread_local Arena arena;
+        return arena;
+    }
+
+    /**
+     *  Frees, when destroyed, everything allocated in the scratch arena
+     *  since its construction. All the scratch buffers created in its scope
+     *  must be destroyed before it. When the outermost scope of a thread
+     *  ends, the arena is trimmed to kept_bytes, so that a long-running
+     *  process does not keep the footprint of its largest operation.
+     */
+    class ScratchScope {
+    private:
+        enum: size_t {
+            kept_bytes = size_t(1) << 26
+        };
+
+        Arena::Mark start;
+
+        // The number of open scopes of the calling thread
+        static size_t& depth() {
+            static thread_local size_t depth = 0;
+            return depth;
+        }
+
+    public:
+        ScratchScope(): start(scratch_arena().mark()) {
+            depth()++;
+        }
+
+        ~ScratchScope() {
+            scratch_arena().rewind(start);
+            if (--depth() == 0)
+                scratch_arena().trim(kept_bytes);
+        }
+    };
+
+    template<typename T>
+    using scratch_vector = std::vector<T, ArenaAllocator<T>>;
+
+    /**
+     *  Returns an empty vector whose memory comes from the scratch arena
+     */
+    template<typename T>
+    scratch_vector<T> make_scratch_vector() {
+        return scratch_vector<T>(ArenaAllocator<T>(&scratch_arena()));
+    }
+
+    /**
+     *  edge_key defines how a graph whose vertices are stored as integers of
+     *  type index_t represents its edges. With 32-bit indices an edge is
+     *  packed in a single 64-bit integer (tail << 32 | head), whose ordering
+     *  is the same as the one of edge_t; with 64-bit indices edge_t itself
+     *  is used.
+     */
+    template<typename index_t>
+    struct edge_key;
+
+    template<>
+    struct edge_key<uint32_t> {
+        typedef uint64_t type;
+
+        static type pack(const edge_t& e) {
+            return uint64_t(e.tail) << 32 | uint64_t(e.head);
+        }
+
+        static edge_t unpack(const type k) {
+            return {vertex_t(k >> 32), vertex_t(k & 0xffffffffULL)};
+        }
+    };
+
+    template<>
+    struct edge_key<uint64_t> {
+        typedef edge_t type;
+
+        static type pack(const edge_t& e) {
+            return e;
+        }
+
+        static edge_t unpack(const type& k) {
+            return k;
+        }
+    };
+
+    /**
+     *  Sorts packed edges with a least significant digit radix sort. Digits
+     *  that are the same in all the keys are skipped, so for graphs with few
+     *  vertices only a couple of passes are done.
+     */
+    template<typename A>
+    void sort_keys(std::vector<uint64_t, A>& keys) {
+        GRAPHGEN_PHASE(SORT);
+        if (keys.size() < (1 << 12)) {
+            std::sort(keys.begin(), keys.end());
+            return;
+        }
+        const int bits = 11;
+        const size_t buckets = 1 << bits;
+        std::vector<uint64_t, A> tmp(keys.size(), 0, keys.get_allocator());
+        std::vector<size_t> count(buckets);
+        for (int shift = 0; shift < 64; shift += bits) {
+            std::fill(count.begin(), count.end(), 0);
+            for (uint64_t k: keys)
+                count[(k >> shift) & (buckets - 1)]++;
+            if (count[(keys[0] >> shift) & (buckets - 1)] == keys.size())
+                continue;
+            size_t sum = 0;
+            for (size_t& c: count) {
+                size_t t = c;
+                c = sum;
+                sum += t;
+            }
+            for (uint64_t k: keys)
+                tmp[count[(k >> shift) & (buckets - 1)]++] = k;
+            keys.swap(tmp);
+        }
+    }
+
+    template<typename A>
+    void sort_keys(std::vector<edge_t, A>& keys) {
+        GRAPHGEN_PHASE(SORT);
+        std::sort(keys.begin(), keys.end());
+    }
+
+    /**
+     *  Sorts keys that are all at most max_key using all the available
+     *  cores: the keys are scattered in one range of values per part, and
+     *  then the parts are sorted independently.
+     */
+    void parallel_sort_keys(std::vector<uint64_t>& keys, const uint64_t max_key) {
+        const size_t parts = std::min(4 * threads_no(), keys.size() >> 16);
+        if (parts <= 1) {
+            sort_keys(keys);
+            return;
+        }
+        GRAPHGEN_PHASE(SORT);
+        const uint64_t width = max_key / parts + 1;
+        const size_t n = keys.size();
+        // count[c][p] is the number of keys of the c-th slice of the input
+        // that fall in the p-th range, and then where they go
+        std::vector<std::vector<size_t>> count(parts, std::vector<size_t>(parts, 0));
+        parallel_for(parts, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++)
+                for (size_t i = n * c / parts; i < n * (c+1) / parts; i++)
+                    count[c][keys[i] / width]++;
+        }, 1);
+        std::vector<size_t> part_begin(parts + 1, 0);
+        size_t sum = 0;
+        for (size_t p = 0; p < parts; p++) {
+            part_begin[p] = sum;
+            for (size_t c = 0; c < parts; c++) {
+                size_t t = count[c][p];
+                count[c][p] = sum;
+                sum += t;
+            }
+        }
+        part_begin[parts] = n;
+
+        std::vector<uint64_t> tmp(n);
+        parallel_for(parts, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++)
+                for (size_t i = n * c / parts; i < n * (c+1) / parts; i++)
+                    tmp[count[c][keys[i] / width]++] = keys[i];
+        }, 1);
+        parallel_for(parts, [&](size_t begin, size_t end) {
+            for (size_t p = begin; p < end; p++)
+                std::sort(tmp.begin() + part_begin[p], tmp.begin() + part_begin[p+1]);
+        }, 1);
+        keys.swap(tmp);
+    }
+
+    /**
+     *  TempFile is an anonymous temporary file holding a sequence of 64-bit
+     *  integers, that is first written and then read back sequentially. It
+     *  is deleted automatically when closed.
+     */
+    class TempFile {
+    private:
+        FILE* file;
+        std::vector<uint64_t> buffer;
+        size_t pos, len;
+
+        void flush() {
+            if (pos > 0 && std::fwrite(buffer.data(), sizeof(uint64_t), pos, file) != pos)
+                throw IOException();
+            pos = 0;
+        }
+
+    public:
+        TempFile(const size_t buffer_size = 1 << 13):
+            file(std::tmpfile()), buffer(buffer_size), pos(0), len(0) {
+            if (!file)
+                throw IOException();
+        }
+
+        ~TempFile() {
+            std::fclose(file);
+        }
+
+        TempFile(const TempFile&) = delete;
+        TempFile& operator=(const TempFile&) = delete;
+
+        void push(const uint64_t v) {
+            buffer[pos++] = v;
+            if (pos == buffer.size())
+                flush();
+        }
+
+        void push(const uint64_t* begin, const uint64_t* end) {
+            while (begin != end)
+                push(*begin++);
+        }
+
+        /**
+         *  Ends the writing phase, and starts reading from the beginning.
+         */
+        void rewind() {
+            flush();
+            std::rewind(file);
+            pos = len = 0;
+        }
+
+        bool next(uint64_t& v) {
+            if (pos == len) {
+                len = std::fread(buffer.data(), sizeof(uint64_t), buffer.size(), file);
+                pos = 0;
+                if (len == 0) {
+                    if (std::ferror(file))
+                        throw IOException();
+                    return false;
+                }
+            }
+            v = buffer[pos++];
+            return true;
+        }
+    };
+
+    /**
+     *  A read-only view of the contents of a file. On POSIX systems the
+     *  file is mapped in memory, so that it is read by the page cache as
+     *  it is accessed and never copied; elsewhere it is read in a buffer.
+     */
+    class MappedFile {
+    private:
+        const char* text;
+        size_t length;
+        bool mapped;
+        std::string buffer;
+
+    public:
+        explicit MappedFile(const std::string& path): text(""), length(0), mapped(false) {
+#ifdef __unix__
+            int fd = open(path.c_str(), O_RDONLY);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) != 0) {
+                if (fd >= 0) close(fd);
+                throw IOException();
+            }
+            length = st.st_size;
+            if (length > 0) {
+                void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p == MAP_FAILED) {
+                    close(fd);
+                    throw IOException();
+                }
+                madvise(p, length, MADV_WILLNEED);
+                text = (const char*) p;
+                mapped = true;
+            }
+            close(fd);
+#else
+            std::ifstream file(path, std::ios::binary);
+            if (!file)
+                throw IOException();
+            buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            text = buffer.data();
+            length = buffer.size();
+#endif
+        }
+
+        ~MappedFile() {
+#ifdef __unix__
+            if (mapped)
+                munmap((void*) text, length);
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const {
+            return text;
+        }
+
+        size_t size() const {
+            return length;
+        }
+    };
+
+    /**
+     *  Parses the decimal number at p, moves p past it and returns false if
+     *  there is none. While at least eight bytes are readable, the digits
+     *  are found and converted eight at a time with SWAR arithmetic on a
+     *  64-bit word instead of one by one.
+     */
+    bool parse_uint(const char*& p, const char* end, uint64_t& res) {
+        const char* start = p;
+        res = 0;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        static const uint64_t pow10[9] = {
+            1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+        };
+        while (end - p >= 8) {
+            uint64_t v;
+            std::memcpy(&v, p, 8);
+            // The high bit of a byte is set if it is above '9' or below '0';
+            // carries and borrows only spoil the bytes after the first one.
+            uint64_t non_digits = ((v + 0x4646464646464646ULL) |
+                                   (v - 0x3030303030303030ULL)) & 0x8080808080808080ULL;
+            size_t len = non_digits ? __builtin_ctzll(non_digits) / 8 : 8;
+            if (len == 0) break;
+            // Drop the bytes after the digits, and pad them with leading
+            // zeros; then combine pairs of digits, of pairs, and so on.
+            uint64_t d = (v - 0x3030303030303030ULL) << (8 * (8 - len));
+            d = (d * 10 + (d >> 8)) & 0x00ff00ff00ff00ffULL;
+            d = (d * 100 + (d >> 16)) & 0x0000ffff0000ffffULL;
+            d = (d * 10000 + (d >> 32)) & 0xffffffffULL;
+            res = res * pow10[len] + d;
+            p += len;
+            if (len < 8) return true;
+        }
+#endif
+        while (p < end && *p >= '0' && *p <= '9')
+            res = 10 * res + (*p++ - '0');
+        return p != start;
+    }
+
+    bool parse_int(const char*& p, const char* end, int64_t& res) {
+        bool negative = p < end && *p == '-';
+        if (negative) p++;
+        uint64_t v;
+        if (!parse_uint(p, end, v))
+            return false;
+        res = negative ? -int64_t(v) : int64_t(v);
+        return true;
+    }
+
+    /**
+     *  Parses a graph in the format written by Graph::write: a line "N M"
+     *  followed by M lines "tail head [weight]", where the labels of the
+     *  vertices go from first_label to first_label + N - 1. Sets
+     *  vertices_no to N, and returns the values that add(tail, head, rest,
+     *  out) appends to out for each edge, in file order, where rest points
+     *  to the rest of the line after the head (for example to its weight).
+     *
+     *  The lines are split in chunks that are parsed in parallel. Throws
+     *  ParseException if the text is malformed, if a label is not one of
+     *  the vertices or if there are not M edges.
+     */
+    template<typename T, typename F>
+    std::vector<T> parse_edges(
+        const char* text,
+        const size_t size,
+        const int64_t first_label,
+        size_t& vertices_no,
+        F add
+    ) {
+        GRAPHGEN_PHASE(PARSE);
+        const char* end = text + size;
+        const char* p = text;
+        auto skip_blanks = [end](const char*& p) {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        };
+        uint64_t n, m;
+        skip_blanks(p);
+        bool ok = parse_uint(p, end, n);
+        skip_blanks(p);
+        if (!ok || !parse_uint(p, end, m))
+            throw ParseException("The first line must contain N and M");
+        p = std::find(p, end, '\n');
+        vertices_no = n;
+
+        // Each chunk starts at the beginning of a line
+        const size_t chunks_no = 4 * threads_no();
+        std::vector<const char*> bounds(chunks_no + 1, end);
+        bounds[0] = p;
+        for (size_t c = 1; c < chunks_no; c++) {
+            const char* q = std::max(bounds[c-1], p + (end - p) * c / chunks_no);
+            bounds[c] = std::find(q, end, '\n');
+        }
+
+        std::vector<std::vector<T>> parts(chunks_no);
+        std::vector<std::string> errors(chunks_no);
+        std::vector<size_t> lines(chunks_no, 0);
+        parallel_for(chunks_no, [&](size_t begin, size_t stop) {
+            for (size_t c = begin; c < stop; c++) {
+                const char* q = bounds[c];
+                std::vector<T>& out = parts[c];
+                while (q < bounds[c+1]) {
+                    q++;  // the newline
+                    skip_blanks(q);
+                    if (q == end || *q == '\n') continue;
+                    int64_t tail, head;
+                    bool good = parse_int(q, end, tail);
+                    skip_blanks(q);
+                    if (!good || !parse_int(q, end, head)) {
+                        errors[c] = "Malformed edge line";
+                        break;
+                    }
+                    tail -= first_label;
+                    head -= first_label;
+                    if (tail < 0 || head < 0 || uint64_t(tail) >= n || uint64_t(head) >= n) {
+                        std::ostringstream os;
+                        os << "Label " << (tail < 0 || uint64_t(tail) >= n ? tail : head) + first_label
+                           << " is not a vertex";
+                        errors[c] = os.str();
+                        break;
+                    }
+                    add(vertex_t(tail), vertex_t(head), q, out);
+                    lines[c]++;
+                    q = std::find(q, end, '\n');
+                }
+            }
+        }, 1);
+        for (const std::string& e: errors)
+            if (!e.empty())
+                throw ParseException(e);
+        size_t edges_no = std::accumulate(lines.begin(), lines.end(), size_t(0));
+        if (edges_no != m) {
+            std::ostringstream os;
+            os << "The file has " << edges_no << " edges instead of " << m;
+            throw ParseException(os.str());
+        }
+
+        std::vector<size_t> offsets(chunks_no + 1, 0);
+        for (size_t c = 0; c < chunks_no; c++)
+            offsets[c+1] = offsets[c] + parts[c].size();
+        std::vector<T> res(offsets[chunks_no]);
+        parallel_for(chunks_no, [&](size_t begin, size_t stop) {
+            for (size_t c = begin; c < stop; c++) {
+                std::copy(parts[c].begin(), parts[c].end(), res.begin() + offsets[c]);
+                std::vector<T>().swap(parts[c]);
+            }
+        }, 1);
+        return res;
+    }
+
+    /**
+     *  Finalizer of the SplitMix64 generator, a fast and good 64-bit mixer.
+     */
+    uint64_t mix64(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+}
+
+/**
+ *  Labeler is the abstract class that defines the interface for a
+ *  graph labeler functor, i.e. a callable object that assigns labels to vertices.
+ */
+template<typename T>
+class Labeler {
+public:
+    typedef T label_t;
+
+    virtual ~Labeler() {}
+
+    /**
+     *  label takes as argument the index of the node, and
+     *  returns a label of type T for it. It must be a deterministic
+     *  injective function.
+     */
+    virtual T operator()(const vertex_t i) = 0;
+
+    /**
+     *  Tells whether the labeler can be called from many threads at the
+     *  same time. If it cannot, graphs are written using a single thread.
+     *  Labelers must opt in by overriding it.
+     */
+    virtual bool is_thread_safe() const {
+        return false;
+    }
+};
+
+/**
+ *  IotaLabeler is the simplest labeler. The label of the i-th vetex
+ *  is simply the integer (i+start).
+ */
+class IotaLabeler: public virtual Labeler<int> {
+private:
+    int start;
+
+public:
+    IotaLabeler(int start = 0): start(start) {}
+    ~IotaLabeler() {}
+
+    int operator()(const vertex_t i) override {
+        return start + i;
+    }
+
+    bool is_thread_safe() const override {
+        return true;
+    }
+};
+
+/**
+ *  RandIntLabeler assigns random labels from a given range
+ */
+class RandIntLabeler: public virtual Labeler<int> {
+private:
+    std::vector<int> labels;
+
+public:
+    /**
+     *  Define the sample range [start, end)
+     */
+    RandIntLabeler(int start, int end) {
+        labels.resize(end - start);
+        std::iota(labels.begin(), labels.end(), start);
+        Random::shuffle(labels.begin(), labels.end());
+    }
+    ~RandIntLabeler() {}
+
+    int operator()(const vertex_t i) {
+        return labels.at(i);
+    }
+
+    bool is_thread_safe() const override {
+        return true;
+    }
+};
+
+/**
+ *  StaticLabeler assigns labels from a given vector
+ */
+template<typename T>
+class StaticLabeler: public Labeler<T> {
+private:
+    std::vector<T>& labels;
+
+public:
+    StaticLabeler(const std::vector<T>& labels): labels(labels) {}
+    ~StaticLabeler() {}
+
+    T operator()(const vertex_t i) {
+        return labels.at(i);
+    }
+
+    bool is_thread_safe() const override {
+        return true;
+    }
+};
+
+/**
+ *  Weighter is the abstract class that defines the interface for a
+ *  graph weighter functor, i.e. a callable object that assigns weights to edges.
+ */
+template<typename T>
+class Weighter {
+public:
+    typedef T weight_t;
+
+    virtual ~Weighter() {}
+
+    /**
+     *  takes as arguments two vertex_t, corresponding to the tail and
+     *  the head vertices of the edge of interest, and returns a weight
+     *  of type T for the edge. It must be a deterministic function.
+     */
+    virtual T operator()(const edge_t& edge) = 0;
+
+    /**
+     *  Computes the weights of n edges at once, storing them in out.
+     *  Weighters that can process many edges faster than one at a time
+     *  should override this.
+     */
+    virtual void operator()(const edge_t* edges, const size_t n, T* out) {
+        for (size_t i = 0; i < n; i++)
+            out[i] = (*this)(edges[i]);
+    }
+
+    /**
+     *  Tells whether the weighter can be called from many threads at the
+     *  same time. If it cannot, when writing a graph the weights are
+     *  computed by a single thread, in the same order as the edges.
+     *  Weighters must opt in by overriding it.
+     */
+    virtual bool is_thread_safe() const {
+        return false;
+    }
+};
+
+template<>
+class Weighter<void> {
+public:
+    typedef void weight_t;
+
+    virtual ~Weighter() {}
+
+    virtual void operator()(const edge_t& edge) = 0;
+
+    virtual bool is_thread_safe() const {
+        return false;
+    }
+};
+
+/**
+ *  Points stores the coordinates of a set of points in the plane. The
+ *  coordinates are kept in two separate arrays, so that loops over them
+ *  can be vectorized.
+ */
+struct Points {
+    std::vector<double> x, y;
+
+    size_t size() const {
+        return x.size();
+    }
+
+    void resize(const size_t n) {
+        x.resize(n);
+        y.resize(n);
+    }
+};
+
+/**
+ *  EuclideanWeighter assigns to each edge the distance between its
+ *  endpoints, multiplied by scale. If T is an integral type, the weights
+ *  are rounded to the nearest integer.
+ */
+template<typename T>
+class EuclideanWeighter: public Weighter<T> {
+private:
+    const Points& points;
+    double scale;
+
+    static T convert(const double w, std::true_type) {
+        return std::llround(w);
+    }
+
+    static T convert(const double w, std::false_type) {
+        return w;
+    }
+
+public:
+    /**
+     *  The points are not copied, so they must outlive the weighter. The
+     *  weighter of a graph must exist before the graph, so to weight the
+     *  edges with the coordinates of the graph itself use
+     *  Graph::assign_euclidean_weights. Throws NoPointsException for an
+     *  edge whose endpoints have no coordinates.
+     */
+    EuclideanWeighter(const Points& points, double scale = 1):
+        points(points), scale(scale) {};
+    ~EuclideanWeighter() {};
+
+    T operator()(const edge_t& e) override {
+        T w;
+        (*this)(&e, 1, &w);
+        return w;
+    }
+
+    void operator()(const edge_t* edges, const size_t n, T* out) override {
+        // We gather the coordinates in small blocks, so that the
+        // computation of the distances is a tight loop over contiguous
+        // arrays that the compiler can vectorize.
+        const size_t block = 256;
+        double dx[block], dy[block];
+        for (size_t start = 0; start < n; start += block) {
+            size_t len = std::min(block, n - start);
+            for (size_t i = 0; i < len; i++) {
+                const edge_t& e = edges[start+i];
+                if (e.tail >= points.size() || e.head >= points.size())
+                    throw NoPointsException();
+                dx[i] = points.x[e.tail] - points.x[e.head];
+                dy[i] = points.y[e.tail] - points.y[e.head];
+            }
+            for (size_t i = 0; i < len; i++)
+                dx[i] = scale * std::sqrt(dx[i]*dx[i] + dy[i]*dy[i]);
+            for (size_t i = 0; i < len; i++)
+                out[start+i] = convert(dx[i], std::is_integral<T>());
+        }
+    }
+
+    bool is_thread_safe() const override {
+        return true;
+    }
+};
+
+/**
+ *  RandomWeighter is the simplest weighter. It returns random weights taken
+ *  from a given range of values
+ */
+template<typename T>
+class RandomWeighter: public Weighter<T> {
+private:
+    T min, max; // Define the range
+
+public:
+    RandomWeighter(T min, T max): min(min), max(max) {};
+    ~RandomWeighter() {};
+
+    T operator()(const edge_t&) {
+        return Random::randrange(min, max);
+    }
+
+    void operator()(const edge_t*, const size_t n, T* out) override {
+        Random::fill(out, n, min, max);
+    }
+
+    bool is_thread_safe() const override {
+        return false;
+    }
+};
+
+/**
+ *  NoWeighter is a dummy weighter. It throws if called
+ */
 class NoWeighter: public Weighter<void> {
 public:
     ~NoWeighter() {};
 
-    void operator()(const edge_t&) {
-        // TODO: Define a proper exception
-        throw NotImplementedException();
+    void operator()(const edge_t&) {
+        // TODO: Define a proper exception
+        throw NotImplementedException();
+    }
+
+    bool is_thread_safe() const override {
+        return true;
+    }
+};
+
+/**
+ *  A ranking numbers the edges that a graph with n vertices can contain,
+ *  from 0 to max_edges(n) - 1, in the same order as the edges themselves.
+ *  Only the edges for which is_valid is true have a rank.
+ *
+ *  TriangularRanking ranks the edges with tail > head, and is used for
+ *  undirected graphs and for DAGs.
+ */
+struct TriangularRanking {
+    enum { id = 0 };
+
+    static bool is_valid(const edge_t& e) {
+        return e.tail > e.head;
+    }
+
+    static uint64_t max_edges(const size_t n) {
+        return (uint64_t)n*(n-1)/2;
+    }
+
+    static uint64_t edge_to_rank(const edge_t& e, const size_t) {
+        return (uint64_t)e.tail*(e.tail-1)/2 + e.head;
+    }
+
+    static edge_t rank_to_edge(const uint64_t rank, const size_t) {
+        edge_t e;
+        e.tail = (1 + std::sqrt(1 + 8*(long double)rank)) / 2;
+        // Fix the rounding errors of sqrt
+        while ((uint64_t)e.tail*(e.tail-1)/2 > rank) e.tail--;
+        while ((uint64_t)(e.tail+1)*e.tail/2 <= rank) e.tail++;
+        e.head = rank - (uint64_t)e.tail*(e.tail-1)/2;
+        return e;
+    }
+};
+
+/**
+ *  SquareRanking ranks all the edges with tail != head, and is used for
+ *  directed graphs.
+ */
+struct SquareRanking {
+    enum { id = 1 };
+
+    static bool is_valid(const edge_t& e) {
+        return e.tail != e.head;
+    }
+
+    static uint64_t max_edges(const size_t n) {
+        return (uint64_t)n*(n-1);
+    }
+
+    static uint64_t edge_to_rank(const edge_t& e, const size_t n) {
+        return (uint64_t)e.tail*(n-1) + e.head - (e.head > e.tail);
+    }
+
+    static edge_t rank_to_edge(const uint64_t rank, const size_t n) {
+        edge_t e;
+        e.tail = rank / (n-1);
+        e.head = rank - (uint64_t)e.tail*(n-1);
+        if (e.head >= e.tail) e.head++;
+        return e;
+    }
+};
+
+/**
+ *  RankIndex keeps the sorted ranks of the edges of a graph, according to
+ *  one ranking, so that they do not have to be recomputed every time new
+ *  random edges are added.
+ *
+ *  The ranks are kept in a few sorted runs of decreasing size. New ranks
+ *  are first collected in a small buffer, which becomes a new run when the
+ *  index is used; runs of similar size are then merged, so each rank is
+ *  moved O(log M) times overall and there are O(log M) runs.
+ */
+class RankIndex {
+private:
+    std::vector<std::vector<uint64_t>> runs;
+    std::vector<uint64_t> pending;
+    size_t ranks_no;
+    bool built;
+
+    /**
+     *  Returns the first position after pos in run whose value is greater
+     *  than x, using exponential search.
+     */
+    static size_t gallop(const std::vector<uint64_t>& run, size_t pos, const uint64_t x) {
+        size_t step = 1;
+        while (pos + step <= run.size() && run[pos + step - 1] <= x) {
+            pos += step;
+            step *= 2;
+        }
+        auto end = run.begin() + std::min(run.size(), pos + step - 1);
+        return std::upper_bound(run.begin() + pos, end, x) - run.begin();
+    }
+
+public:
+    RankIndex(): ranks_no(0), built(false) {}
+
+    /**
+     *  Tells whether the index contains the ranks of all the edges of the
+     *  graph. If it does not, it must be rebuilt before being used.
+     */
+    bool is_built() const {
+        return built;
+    }
+
+    void clear() {
+        runs.clear();
+        pending.clear();
+        ranks_no = 0;
+        built = false;
+    }
+
+    /**
+     *  Initializes the index with the given sorted ranks.
+     */
+    void build(std::vector<uint64_t>&& ranks) {
+        clear();
+        built = true;
+        add_run(std::move(ranks));
+    }
+
+    size_t size() const {
+        return ranks_no;
+    }
+
+    /**
+     *  Adds the rank of a new edge.
+     */
+    void add(const uint64_t rank) {
+        pending.push_back(rank);
+        ranks_no++;
+    }
+
+    /**
+     *  Adds the ranks of many new edges, which must be sorted.
+     */
+    void add_run(std::vector<uint64_t>&& ranks) {
+        if (ranks.empty()) return;
+        ranks_no += ranks.size();
+        runs.push_back(std::move(ranks));
+        while (runs.size() >= 2 &&
+               runs[runs.size() - 2].size() <= 2 * runs.back().size()) {
+            std::vector<uint64_t> merged(runs[runs.size() - 2].size() + runs.back().size());
+            std::merge(
+                runs[runs.size() - 2].begin(), runs[runs.size() - 2].end(),
+                runs.back().begin(), runs.back().end(),
+                merged.begin()
+            );
+            runs.pop_back();
+            runs.back().swap(merged);
+        }
+    }
+
+    /**
+     *  Moves the pending ranks to a new run.
+     */
+    void flush() {
+        if (pending.empty()) return;
+        std::vector<uint64_t> run;
+        run.swap(pending);
+        utils::sort_keys(run);
+        ranks_no -= run.size();
+        add_run(std::move(run));
+    }
+
+    /**
+     *  Takes sorted values v_0 <= v_1 <= ... and replaces v_i with the
+     *  (v_i + i)-th value that is not in the index. This is the last step
+     *  of RangeSampler. The runs are scanned with exponential searches, so
+     *  the cost is O(K log(M / K)) for K samples instead of O(M).
+     */
+    template<typename V>
+    void skip_excluded(V& values) {
+        flush();
+        std::vector<size_t> pos(runs.size(), 0);
+        uint64_t skipped = 0;
+        for (size_t i = 0; i < values.size(); i++) {
+            uint64_t x = values[i] + i + skipped;
+            bool moved = true;
+            while (moved) {
+                moved = false;
+                for (size_t r = 0; r < runs.size(); r++) {
+                    size_t next = gallop(runs[r], pos[r], x);
+                    if (next != pos[r]) {
+                        skipped += next - pos[r];
+                        x += next - pos[r];
+                        pos[r] = next;
+                        moved = true;
+                    }
+                }
+            }
+            values[i] = x;
+        }
+    }
+};
+
+/**
+ *  RangeSampler provides iterators for ranging over sampled integers
+ *  in a given range.
+ */
+class RangeSampler {
+public:
+    typedef utils::ArenaAllocator<int64_t> allocator_type;
+    typedef std::vector<int64_t, allocator_type>::iterator iterator;
+
+private:
+    std::vector<int64_t, allocator_type> samples;
+
+public:
+    /**
+     *  The constructor generates the samples from the range [min, max].
+     *
+     *  @param sample_size the number of samples
+     *  @param min the min of the range
+     *  @param max the max of the range
+     *  @param excl an optional vector of undesired values
+     *  @param alloc the allocator of the samples, for example one using
+     *               the scratch arena
+     */
+    RangeSampler(
+        const size_t sample_size,
+        const int64_t min,
+        const int64_t max,
+        std::vector<int64_t> excl = std::vector<int64_t>(),
+        const allocator_type& alloc = allocator_type()
+    ): samples(alloc) {
+        GRAPHGEN_PHASE(SAMPLE);
+        if (!std::is_sorted(excl.begin(), excl.end()))
+            std::sort(excl.begin(), excl.end());
+
+        // If the user requests too many samples, throw
+        if (max - min < int64_t(sample_size + excl.size()))
+            throw TooManySamplesException();
+
+        auto top = max - sample_size - excl.size() + 1;
+        samples.resize(sample_size);
+        Random::fill(samples.data(), sample_size, min, int64_t(top));
+
+        // TODO: Is counting sort better than std::sort here?
+        {
+            GRAPHGEN_PHASE(SORT);
+            std::sort(samples.begin(), samples.end());
+        }
+        size_t excl_idx = 0;
+        for (size_t i = 0; i < sample_size; i++) {
+            while (excl_idx < excl.size() &&
+                   excl[excl_idx] <= samples[i] + int64_t(i + excl_idx))
+                excl_idx++;
+            samples[i] += i + excl_idx;
+        }
+    }
+
+    /**
+     *  Same as above, but the undesired values are taken from a RankIndex,
+     *  which avoids scanning all of them. The range must be non-negative.
+     */
+    RangeSampler(
+        const size_t sample_size,
+        const int64_t min,
+        const int64_t max,
+        RankIndex& excl,
+        const allocator_type& alloc = allocator_type()
+    ): samples(alloc) {
+        GRAPHGEN_PHASE(SAMPLE);
+        if (max - min < int64_t(sample_size + excl.size()))
+            throw TooManySamplesException();
+
+        auto top = max - sample_size - excl.size() + 1;
+        samples.resize(sample_size);
+        Random::fill(samples.data(), sample_size, min, int64_t(top));
+        {
+            GRAPHGEN_PHASE(SORT);
+            std::sort(samples.begin(), samples.end());
+        }
+        excl.skip_excluded(samples);
+    }
+
+    iterator begin() {
+        return samples.begin();
+    }
+
+    iterator end() {
+        return samples.end();
+    }
+};
+
+/**
+ *  A disjoint set that many threads can merge into at the same time. Roots
+ *  are linked with a compare-and-swap, always the one with the larger index
+ *  below the other, so that no cycles can form; find halves the paths.
+ */
+class ConcurrentDisjointSet {
+private:
+    std::unique_ptr<std::atomic<size_t>[]> parent;
+    size_t N;
+
+public:
+    ConcurrentDisjointSet(const size_t N): parent(new std::atomic<size_t>[N]), N(N) {
+        utils::parallel_for(N, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                parent[i].store(i, std::memory_order_relaxed);
+        });
+    }
+
+    size_t size() const {
+        return N;
+    }
+
+    size_t find(size_t a) {
+        while (true) {
+            size_t p = parent[a].load(std::memory_order_relaxed);
+            if (p == a) return a;
+            size_t gp = parent[p].load(std::memory_order_relaxed);
+            if (gp != p)
+                parent[a].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+            a = gp;
+        }
+    }
+
+    /**
+     *  Merges the sets of a and b, and returns false if they were already
+     *  the same set
+     */
+    bool merge(size_t a, size_t b) {
+        while (true) {
+            a = find(a);
+            b = find(b);
+            if (a == b) return false;
+            if (a < b) std::swap(a, b);
+            // Fails if another thread has linked a in the meantime
+            size_t expected = a;
+            if (parent[a].compare_exchange_strong(expected, b))
+                return true;
+        }
+    }
+};
+
+/**
+ *  A disjoint set that also keeps the list of its roots, so that the sets
+ *  can be counted and listed in time proportional to their number, and a
+ *  uniformly random member of each set. When two sets are merged, the
+ *  member of the result is taken from either of them with probability
+ *  proportional to its size, which keeps it uniform.
+ *
+ *  The choices are drawn from a generator of the set, seeded from the
+ *  state of the generator of the calling thread without advancing it, so
+ *  that building or updating the components does not change the graphs
+ *  generated afterwards.
+ */
+class ComponentSet {
+private:
+    std::vector<size_t> parent, size, member, position, roots;
+    uint64_t state;
+
+public:
+    ComponentSet(const size_t N = 0):
+        parent(N), size(N, 1), member(N), position(N), roots(N),
+        state(Random::x ^ (Random::w << 1)) {
+        std::iota(parent.begin(), parent.end(), 0);
+        std::iota(member.begin(), member.end(), 0);
+        std::iota(position.begin(), position.end(), 0);
+        std::iota(roots.begin(), roots.end(), 0);
+    }
+
+    size_t find(size_t a) {
+        while (parent[a] != a)
+            a = parent[a] = parent[parent[a]];
+        return a;
+    }
+
+    /**
+     *  Merges the sets of a and b, and returns false if they were already
+     *  the same set
+     */
+    bool merge(size_t a, size_t b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return false;
+        if (size[a] > size[b])
+            std::swap(a, b);
+        if (Random::splitmix64(state) % (size[a] + size[b]) < size[a])
+            member[b] = member[a];
+        parent[a] = b;
+        size[b] += size[a];
+        // a is no longer a root: move the last root in its place
+        roots[position[a]] = roots.back();
+        position[roots.back()] = position[a];
+        roots.pop_back();
+        return true;
+    }
+
+    size_t count() const {
+        return roots.size();
+    }
+
+    const std::vector<size_t>& get_roots() const {
+        return roots;
+    }
+
+    /**
+     *  Returns a uniformly random member of the set with the given root
+     */
+    size_t random_member(const size_t root) const {
+        return member[root];
+    }
+};
+
+/**
+ *  EdgeStore is a set of 64-bit keys that can also return a uniformly
+ *  random element in constant time. The keys are kept in an array, and an
+ *  open addressing hash table with linear probing maps each of them to its
+ *  position in the array; erase moves the last key in place of the erased
+ *  one, so the array has no holes.
+ */
+class EdgeStore {
+private:
+    enum: size_t { EMPTY = std::numeric_limits<size_t>::max() };
+
+    std::vector<uint64_t> keys;
+    std::vector<size_t> table;
+    size_t mask;
+
+    size_t home(const uint64_t key) const {
+        return utils::mix64(key) & mask;
+    }
+
+    /**
+     *  Returns the slot of the table that holds the position of key, or
+     *  the empty slot where it would go
+     */
+    size_t slot(const uint64_t key) const {
+        size_t i = home(key);
+        while (table[i] != EMPTY && keys[table[i]] != key)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    void grow() {
+        table.assign(2 * table.size(), EMPTY);
+        mask = table.size() - 1;
+        for (size_t p = 0; p < keys.size(); p++)
+            table[slot(keys[p])] = p;
+    }
+
+public:
+    /**
+     *  @param expected the number of keys the set is expected to hold
+     */
+    EdgeStore(const size_t expected = 0) {
+        size_t capacity = 16;
+        while (capacity < 2 * expected) capacity *= 2;
+        table.assign(capacity, EMPTY);
+        mask = capacity - 1;
+        keys.reserve(expected);
+    }
+
+    size_t size() const {
+        return keys.size();
+    }
+
+    bool empty() const {
+        return keys.empty();
+    }
+
+    /**
+     *  Returns the keys, in no particular order
+     */
+    const std::vector<uint64_t>& get_keys() const {
+        return keys;
+    }
+
+    bool count(const uint64_t key) const {
+        return table[slot(key)] != EMPTY;
+    }
+
+    bool insert(const uint64_t key) {
+        if (2 * (keys.size() + 1) > table.size()) grow();
+        size_t i = slot(key);
+        if (table[i] != EMPTY) return false;
+        table[i] = keys.size();
+        keys.push_back(key);
+        return true;
+    }
+
+    bool erase(const uint64_t key) {
+        size_t i = slot(key);
+        if (table[i] == EMPTY) return false;
+        // The last key takes the position of the erased one
+        const size_t p = table[i];
+        table[slot(keys.back())] = p;
+        keys[p] = keys.back();
+        keys.pop_back();
+        // Backward shift deletion, as in HashSet
+        for (size_t j = (i + 1) & mask; table[j] != EMPTY; j = (j + 1) & mask) {
+            if (((j - home(keys[table[j]])) & mask) >= ((j - i) & mask)) {
+                table[i] = table[j];
+                i = j;
+            }
+        }
+        table[i] = EMPTY;
+        return true;
+    }
+
+    /**
+     *  Returns a uniformly random key; the set must not be empty
+     */
+    uint64_t random() const {
+        return keys[Random::randrange(size_t(0), keys.size())];
+    }
+};
+
+/**
+ *  A disjoint set without path compression, whose merges can be undone in
+ *  the opposite order. Union by size keeps find logarithmic.
+ */
+class RollbackDisjointSet {
+private:
+    // The parent of each element, or minus the size of the set for roots
+    std::vector<int64_t> parent;
+    // The roots linked by each merge, with their old values in parent
+    std::vector<std::pair<size_t, int64_t>> history;
+
+public:
+    RollbackDisjointSet(const size_t N = 0): parent(N, -1) {}
+
+    size_t find(size_t a) const {
+        while (parent[a] >= 0)
+            a = parent[a];
+        return a;
+    }
+
+    /**
+     *  Merges the sets of a and b, and returns false if they were already
+     *  the same set
+     */
+    bool merge(size_t a, size_t b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) return false;
+        if (parent[a] < parent[b])
+            std::swap(a, b);
+        history.push_back({a, parent[a]});
+        parent[b] += parent[a];
+        parent[a] = b;
+        return true;
+    }
+
+    /**
+     *  Returns the number of merges done so far, to be passed to rollback
+     */
+    size_t snapshot() const {
+        return history.size();
+    }
+
+    /**
+     *  Undoes the merges done after the given snapshot
+     */
+    void rollback(const size_t snapshot) {
+        while (history.size() > snapshot) {
+            const std::pair<size_t, int64_t> h = history.back();
+            history.pop_back();
+            parent[parent[h.first]] -= h.second;
+            parent[h.first] = h.second;
+        }
+    }
+};
+
+/**
+ *  Checks of the structural properties of a graph, used by Graph::verify
+ *  and by the standalone verifier (verify.cpp). The edges are given as
+ *  packed keys (tail << 32 | head); undirected edges must have
+ *  tail >= head. Every check runs in parallel over the keys.
+ */
+namespace verifier {
+    enum property_t: unsigned {
+        SIMPLE = 1,         // no self loops and no multiple edges
+        CONNECTED = 2,      // weakly connected, for directed graphs
+        ACYCLIC = 4,        // a forest, or a DAG for directed graphs
+        TREE = 8            // the underlying undirected graph is a tree
+    };
+
+    /**
+     *  Parses a list of property names separated by spaces or commas,
+     *  for example "simple,connected"
+     */
+    unsigned parse_properties(const std::string& names) {
+        std::string text = names;
+        std::replace(text.begin(), text.end(), ',', ' ');
+        std::istringstream is(text);
+        unsigned res = 0;
+        std::string name;
+        while (is >> name) {
+            if (name == "simple") res |= SIMPLE;
+            else if (name == "connected") res |= CONNECTED;
+            else if (name == "acyclic" || name == "dag" || name == "forest") res |= ACYCLIC;
+            else if (name == "tree") res |= TREE;
+            else throw VerificationException("Unknown property " + name);
+        }
+        return res;
+    }
+
+    uint64_t pack(const vertex_t tail, const vertex_t head) {
+        return uint64_t(tail) << 32 | uint64_t(head);
+    }
+
+    std::string describe(const uint64_t k) {
+        std::ostringstream os;
+        os << "(" << (k >> 32) << ", " << (k & 0xffffffffULL) << ")";
+        return os.str();
+    }
+
+    /**
+     *  Returns the smallest position in [0, n) for which bad is true, or n
+     */
+    template<typename F>
+    size_t find_first(const size_t n, F bad) {
+        std::atomic<size_t> first(n);
+        utils::parallel_for(n, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end && i < first; i++) {
+                if (!bad(i)) continue;
+                size_t current = first;
+                while (i < current && !first.compare_exchange_weak(current, i)) {}
+                return;
+            }
+        });
+        return first;
+    }
+
+    /**
+     *  Kahn's algorithm, one frontier of sources at a time: the out-edges
+     *  of the frontier are scanned in parallel, and the vertices whose last
+     *  in-edge is removed form the next frontier. Returns the number of
+     *  vertices that get removed, which is vertices_no for a DAG.
+     */
+    size_t topological_count(const size_t vertices_no, const std::vector<uint64_t>& keys) {
+        // Out-edges of v are keys[offsets[v]] ... keys[offsets[v+1] - 1]
+        std::vector<size_t> offsets(vertices_no + 1);
+        std::unique_ptr<std::atomic<size_t>[]> in_degree(new std::atomic<size_t>[vertices_no]);
+        utils::parallel_for(vertices_no + 1, [&](size_t begin, size_t end) {
+            for (size_t v = begin; v < end; v++) {
+                offsets[v] = std::lower_bound(keys.begin(), keys.end(), pack(v, 0)) - keys.begin();
+                if (v < vertices_no)
+                    in_degree[v].store(0, std::memory_order_relaxed);
+            }
+        });
+        utils::parallel_for(keys.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                in_degree[keys[i] & 0xffffffffULL].fetch_add(1, std::memory_order_relaxed);
+        });
+
+        std::mutex mutex;
+        std::vector<vertex_t> frontier, next;
+        utils::parallel_for(vertices_no, [&](size_t begin, size_t end) {
+            std::vector<vertex_t> sources;
+            for (size_t v = begin; v < end; v++)
+                if (in_degree[v] == 0)
+                    sources.push_back(v);
+            std::lock_guard<std::mutex> lock(mutex);
+            frontier.insert(frontier.end(), sources.begin(), sources.end());
+        });
+        size_t removed = 0;
+        while (!frontier.empty()) {
+            removed += frontier.size();
+            next.clear();
+            utils::parallel_for(frontier.size(), [&](size_t begin, size_t end) {
+                std::vector<vertex_t> sources;
+                for (size_t i = begin; i < end; i++) {
+                    vertex_t v = frontier[i];
+                    for (size_t j = offsets[v]; j < offsets[v+1]; j++) {
+                        vertex_t head = keys[j] & 0xffffffffULL;
+                        if (in_degree[head].fetch_sub(1) == 1)
+                            sources.push_back(head);
+                    }
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                next.insert(next.end(), sources.begin(), sources.end());
+            }, 1 << 10);
+            frontier.swap(next);
+        }
+        return removed;
+    }
+
+    /**
+     *  Checks the given properties, and throws a VerificationException
+     *  describing the first one that does not hold. If edges_no is not
+     *  negative, the number of edges is checked as well. The keys are
+     *  sorted in place.
+     */
+    void check(
+        const size_t vertices_no,
+        std::vector<uint64_t>& keys,
+        const bool directed,
+        const unsigned properties,
+        const int64_t edges_no = -1
+    ) {
+        GRAPHGEN_PHASE(VERIFY);
+        if (vertices_no > (uint64_t(1) << 32))
+            throw TooManyNodesException();
+        if (edges_no >= 0 && keys.size() != uint64_t(edges_no)) {
+            std::ostringstream os;
+            os << "The graph has " << keys.size() << " edges instead of " << edges_no;
+            throw VerificationException(os.str());
+        }
+        if (vertices_no == 0)
+            return;
+        if (!std::is_sorted(keys.begin(), keys.end()))
+            utils::parallel_sort_keys(keys, pack(vertices_no - 1, vertices_no - 1));
+
+        if (properties & SIMPLE) {
+            size_t i = find_first(keys.size(), [&](size_t i) {
+                return (keys[i] >> 32) == (keys[i] & 0xffffffffULL);
+            });
+            if (i < keys.size())
+                throw VerificationException("Self loop " + describe(keys[i]));
+            i = find_first(keys.size(), [&](size_t i) {
+                return i > 0 && keys[i] == keys[i-1];
+            });
+            if (i < keys.size())
+                throw VerificationException("Multiple edge " + describe(keys[i]));
+        }
+
+        if (properties & (CONNECTED | TREE | (directed ? 0 : ACYCLIC))) {
+            // Every successful merge joins two components, and every edge
+            // that closes a cycle fails to merge
+            ConcurrentDisjointSet components(vertices_no);
+            std::atomic<size_t> merges(0);
+            utils::parallel_for(keys.size(), [&](size_t begin, size_t end) {
+                size_t local = 0;
+                for (size_t i = begin; i < end; i++)
+                    local += components.merge(keys[i] >> 32, keys[i] & 0xffffffffULL);
+                merges += local;
+            });
+            size_t components_no = vertices_no - merges;
+            if ((properties & (CONNECTED | TREE)) && components_no > 1) {
+                std::ostringstream os;
+                os << "The graph has " << components_no << " connected components";
+                throw VerificationException(os.str());
+            }
+            if ((properties & TREE) && keys.size() != vertices_no - 1)
+                throw VerificationException("The graph is not a tree");
+            if ((properties & ACYCLIC) && !directed && merges != keys.size())
+                throw VerificationException("The graph has a cycle");
+        }
+
+        if ((properties & ACYCLIC) && directed &&
+            topological_count(vertices_no, keys) != vertices_no)
+            throw VerificationException("The graph has a cycle");
+    }
+}
+
+/**
+ *  Hashes of graphs that do not depend on the order of their edges, used
+ *  to find duplicate test cases by Graph::fingerprint and by the batch
+ *  tool (fingerprint.cpp). The edges are given as packed keys, as for
+ *  verifier, together with the hashes of their weights (hash_text of the
+ *  way they are written) aligned with the keys, or no weights at all.
+ *
+ *  Each hash is a 128-bit sum of the mixes of some values, one for each
+ *  edge or vertex, which is computed in parallel and with AVX2 if the
+ *  machine has it; the result is the same either way.
+ */
+namespace fingerprints {
+    struct value_t {
+        uint64_t hi, lo;
+
+        bool operator==(const value_t& other) const {
+            return hi == other.hi && lo == other.lo;
+        }
+
+        bool operator!=(const value_t& other) const {
+            return !(*this == other);
+        }
+
+        bool operator<(const value_t& other) const {
+            return hi < other.hi || (hi == other.hi && lo < other.lo);
+        }
+
+        /**
+         *  Returns the value as 32 hexadecimal digits
+         */
+        std::string to_string() const {
+            char buf[33];
+            snprintf(buf, sizeof(buf), "%016llx%016llx",
+                     (unsigned long long) hi, (unsigned long long) lo);
+            return buf;
+        }
+    };
+
+    // The seeds of the two halves of the hashes
+    const uint64_t seed_lo = 0x243f6a8885a308d3ULL;
+    const uint64_t seed_hi = 0x13198a2e03707344ULL;
+
+    /**
+     *  Adds mix64(x ^ seed_lo) and mix64(x ^ seed_hi) to lo and hi, for
+     *  each of the n values x
+     */
+    void accumulate_scalar(const uint64_t* x, const size_t n, uint64_t& lo, uint64_t& hi) {
+        for (size_t i = 0; i < n; i++) {
+            lo += utils::mix64(x[i] ^ seed_lo);
+            hi += utils::mix64(x[i] ^ seed_hi);
+        }
+    }
+
+#ifdef GRAPHGEN_HAVE_AVX2
+    /**
+     *  Multiplies each lane of a by b, modulo 2^64. AVX2 can only multiply
+     *  32-bit halves, so the product is made of three of them.
+     */
+    __attribute__((target("avx2")))
+    inline __m256i mul64_avx2(const __m256i a, const uint64_t b) {
+        const __m256i b_lo = _mm256_set1_epi64x(b & 0xffffffffULL);
+        const __m256i b_hi = _mm256_set1_epi64x(b >> 32);
+        __m256i cross = _mm256_add_epi64(
+            _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b_lo),
+            _mm256_mul_epu32(a, b_hi)
+        );
+        return _mm256_add_epi64(_mm256_mul_epu32(a, b_lo), _mm256_slli_epi64(cross, 32));
+    }
+
+    /**
+     *  utils::mix64 of each lane
+     */
+    __attribute__((target("avx2")))
+    inline __m256i mix64_avx2(__m256i x) {
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 30));
+        x = mul64_avx2(x, 0xbf58476d1ce4e5b9ULL);
+        x = _mm256_xor_si256(x, _mm256_srli_epi64(x, 27));
+        x = mul64_avx2(x, 0x94d049bb133111ebULL);
+        return _mm256_xor_si256(x, _mm256_srli_epi64(x, 31));
+    }
+
+    __attribute__((target("avx2")))
+    void accumulate_avx2(const uint64_t* x, const size_t n, uint64_t& lo, uint64_t& hi) {
+        const __m256i s_lo = _mm256_set1_epi64x(seed_lo);
+        const __m256i s_hi = _mm256_set1_epi64x(seed_hi);
+        __m256i acc_lo = _mm256_setzero_si256(), acc_hi = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (x + i));
+            acc_lo = _mm256_add_epi64(acc_lo, mix64_avx2(_mm256_xor_si256(v, s_lo)));
+            acc_hi = _mm256_add_epi64(acc_hi, mix64_avx2(_mm256_xor_si256(v, s_hi)));
+        }
+        uint64_t l[4], h[4];
+        _mm256_storeu_si256((__m256i*) l, acc_lo);
+        _mm256_storeu_si256((__m256i*) h, acc_hi);
+        lo += l[0] + l[1] + l[2] + l[3];
+        hi += h[0] + h[1] + h[2] + h[3];
+        accumulate_scalar(x + i, n - i, lo, hi);
+    }
+#endif
+
+    /**
+     *  Tells whether the hashes are computed with AVX2. Turning it off
+     *  does not change them.
+     */
+    bool use_avx2 = Random::has_avx2();
+
+    /**
+     *  Returns the sums of the mixes of the values, which do not depend on
+     *  their order
+     */
+    value_t sum(const std::vector<uint64_t>& values) {
+        std::atomic<uint64_t> lo(0), hi(0);
+        utils::parallel_for(values.size(), [&](size_t begin, size_t end) {
+            uint64_t l = 0, h = 0;
+#ifdef GRAPHGEN_HAVE_AVX2
+            if (use_avx2)
+                accumulate_avx2(values.data() + begin, end - begin, l, h);
+            else
+#endif
+            accumulate_scalar(values.data() + begin, end - begin, l, h);
+            lo += l;
+            hi += h;
+        });
+        return {hi.load(), lo.load()};
+    }
+
+    /**
+     *  Mixes the size of the graph and its kind into the sums
+     */
+    value_t finish(value_t sums, const size_t vertices_no, const size_t edges_no, const bool directed) {
+        sums.lo ^= utils::mix64(2 * uint64_t(vertices_no) + directed);
+        sums.hi ^= utils::mix64(uint64_t(edges_no) ^ seed_hi);
+        return sums;
+    }
+
+    /**
+     *  Hashes the graph with its labels: the hash only depends on the set
+     *  of the edges with their weights.
+     */
+    value_t of_edges(
+        const size_t vertices_no,
+        const std::vector<uint64_t>& keys,
+        const std::vector<uint64_t>& weights,
+        const bool directed
+    ) {
+        if (weights.empty())
+            return finish(sum(keys), vertices_no, keys.size(), directed);
+        std::vector<uint64_t> values(keys.size());
+        utils::parallel_for(keys.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                values[i] = keys[i] ^ utils::mix64(weights[i]);
+        });
+        return finish(sum(values), vertices_no, keys.size(), directed);
+    }
+
+    /**
+     *  Hashes the graph up to isomorphism, with rounds of Weisfeiler-Lehman
+     *  refinement: all the vertices start with the same color, and at each
+     *  round each of them gets a new one from its color and the multiset of
+     *  the colors of its neighbors, together with the weights of the edges
+     *  and, in directed graphs, their direction. After the first round the
+     *  colors encode the degrees, so with one round this is a hash of the
+     *  degree sequence.
+     *
+     *  Isomorphic graphs have the same hash, but so do the graphs that the
+     *  refinement cannot tell apart, such as regular graphs of the same
+     *  size and degree.
+     */
+    value_t invariant(
+        const size_t vertices_no,
+        const std::vector<uint64_t>& keys,
+        const std::vector<uint64_t>& weights,
+        const bool directed,
+        const size_t rounds = 3
+    ) {
+        // Both endpoints of each edge see the other one as a neighbor; tags
+        // tell apart the weights and the directions
+        const uint64_t out_tag = directed ? 0x452821e638d01377ULL : 0;
+        const uint64_t in_tag = directed ? 0xbe5466cf34e90c6cULL : 0;
+        std::vector<size_t> offsets(vertices_no + 1, 0);
+        for (uint64_t k: keys) {
+            offsets[(k >> 32) + 1]++;
+            offsets[(k & 0xffffffffULL) + 1]++;
+        }
+        for (size_t v = 0; v < vertices_no; v++)
+            offsets[v+1] += offsets[v];
+        std::vector<uint32_t> neighbors(offsets[vertices_no]);
+        std::vector<uint64_t> tags(offsets[vertices_no]);
+        {
+            std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < keys.size(); i++) {
+                uint32_t tail = keys[i] >> 32, head = keys[i] & 0xffffffffULL;
+                uint64_t tag = weights.empty() ? 0 : utils::mix64(weights[i]);
+                neighbors[pos[tail]] = head;
+                tags[pos[tail]++] = tag ^ out_tag;
+                neighbors[pos[head]] = tail;
+                tags[pos[head]++] = tag ^ in_tag;
+            }
+        }
+
+        std::vector<uint64_t> colors(vertices_no, 1), next(vertices_no);
+        for (size_t r = 0; r < rounds; r++) {
+            utils::parallel_for(vertices_no, [&](size_t begin, size_t end) {
+                for (size_t v = begin; v < end; v++) {
+                    uint64_t s = 0;
+                    for (size_t j = offsets[v]; j < offsets[v+1]; j++)
+                        s += utils::mix64(colors[neighbors[j]] + tags[j]);
+                    next[v] = utils::mix64(colors[v] ^ utils::mix64(s + seed_lo));
+                }
+            }, 1 << 12);
+            colors.swap(next);
+        }
+        return finish(sum(colors), vertices_no, keys.size(), directed);
+    }
+}
+
+/**
+ *  Streams of edge insertions, edge removals and connectivity queries on
+ *  a graph, written by Graph::write_updates. The edges and the queries are
+ *  packed as for verifier, with tail >= head if undirected.
+ */
+namespace updates {
+    enum kind_t: uint8_t {
+        INSERT,
+        REMOVE,
+        QUERY
+    };
+
+    struct operation_t {
+        uint64_t edge;      // the two vertices of a query
+        kind_t kind;
+    };
+
+    edge_t unpack(const uint64_t k) {
+        return {vertex_t(k >> 32), vertex_t(k & 0xffffffffULL)};
+    }
+
+    /**
+     *  Answers the queries of a block of operations offline, with the
+     *  divide and conquer over time of dynamic connectivity. Each edge
+     *  touched by the block is present during some intervals of it, which
+     *  are split among the nodes of a segment tree over the positions of
+     *  the operations; going down the tree the intervals that cover a node
+     *  are merged in a RollbackDisjointSet, and going up they are undone.
+     *  The edges that the block does not touch are merged once at the
+     *  start, so a block of B operations takes O((M + B log B) log N).
+     */
+    class OfflineConnectivity {
+    private:
+        // The vertices are replaced by the roots of their sets after the
+        // untouched edges are merged, so the finds only climb the merges
+        // of the intervals
+        struct interval_t {
+            uint32_t begin, end, a, b;
+        };
+
+        size_t vertices_no;
+        RollbackDisjointSet dsu;
+        // The intervals that reach the node being solved at each depth
+        std::vector<std::vector<interval_t>> levels;
+        std::vector<size_t> queries_before;
+        std::vector<std::pair<size_t, size_t>> queried;
+
+        void solve(
+            const size_t lo,
+            const size_t hi,
+            const size_t depth,
+            std::vector<bool>& answers
+        ) {
+            if (queries_before[hi] == queries_before[lo]) return;
+            const size_t snapshot = dsu.snapshot();
+            std::vector<interval_t>& current = levels[depth];
+            size_t kept = 0;
+            for (const interval_t& in: current) {
+                if (in.begin <= lo && hi <= in.end)
+                    dsu.merge(in.a, in.b);
+                else
+                    current[kept++] = in;
+            }
+            current.resize(kept);
+            if (hi - lo == 1) {
+                const std::pair<size_t, size_t>& q = queried[queries_before[lo]];
+                answers[queries_before[lo]] = dsu.find(q.first) == dsu.find(q.second);
+            } else {
+                const size_t mid = lo + (hi - lo) / 2;
+                const size_t bounds[3] = {lo, mid, hi};
+                for (size_t half = 0; half < 2; half++) {
+                    std::vector<interval_t>& next = levels[depth + 1];
+                    next.clear();
+                    for (const interval_t& in: current)
+                        if (in.begin < bounds[half + 1] && bounds[half] < in.end)
+                            next.push_back(in);
+                    solve(bounds[half], bounds[half + 1], depth + 1, answers);
+                }
+            }
+            dsu.rollback(snapshot);
+        }
+
+    public:
+        OfflineConnectivity(const size_t vertices_no): vertices_no(vertices_no) {}
+
+        /**
+         *  Returns the answers to the queries in ops, in order: true if
+         *  the two vertices are connected after the operations before the
+         *  query. edges are the edges of the graph after all of ops.
+         */
+        std::vector<bool> answer(
+            const std::vector<uint64_t>& edges,
+            const std::vector<operation_t>& ops
+        ) {
+            dsu = RollbackDisjointSet(vertices_no);
+            queries_before.assign(ops.size() + 1, 0);
+            std::vector<std::pair<uint64_t, size_t>> events;
+            for (size_t i = 0; i < ops.size(); i++) {
+                queries_before[i + 1] = queries_before[i] + (ops[i].kind == QUERY);
+                if (ops[i].kind != QUERY)
+                    events.push_back({ops[i].edge, i});
+            }
+            std::sort(events.begin(), events.end());
+
+            EdgeStore touched(events.size());
+            for (const std::pair<uint64_t, size_t>& ev: events)
+                touched.insert(ev.first);
+            for (uint64_t k: edges) {
+                if (touched.count(k)) continue;
+                edge_t e = unpack(k);
+                dsu.merge(e.tail, e.head);
+            }
+
+            size_t depth = 2;
+            while ((size_t(1) << (depth - 2)) < ops.size()) depth++;
+            levels.resize(depth);
+            levels[0].clear();
+            for (size_t i = 0; i < events.size(); ) {
+                const uint64_t k = events[i].first;
+                edge_t e = unpack(k);
+                const uint32_t a = dsu.find(e.tail), b = dsu.find(e.head);
+                // Insertions and removals of an edge alternate, and the
+                // edge was there from the start if the first is a removal
+                uint32_t begin = 0;
+                for (; i < events.size() && events[i].first == k; i++) {
+                    const uint32_t t = events[i].second;
+                    if (ops[t].kind == INSERT)
+                        begin = t + 1;
+                    else if (begin < t && a != b)
+                        levels[0].push_back({begin, t, a, b});
+                }
+                if (ops[events[i - 1].second].kind == INSERT && begin < ops.size() && a != b)
+                    levels[0].push_back({begin, uint32_t(ops.size()), a, b});
+            }
+            queried.clear();
+            for (const operation_t& op: ops) {
+                if (op.kind != QUERY) continue;
+                edge_t e = unpack(op.edge);
+                queried.push_back({dsu.find(e.tail), dsu.find(e.head)});
+            }
+
+            std::vector<bool> answers(queries_before.back());
+            if (!ops.empty())
+                solve(0, ops.size(), 0, answers);
+            return answers;
+        }
+    };
+}
+
+/**
+ *  Graph is an abstract class
+ *
+ *  The vertices are stored as integers of type index_t, which can be either
+ *  uint32_t (the default) or uint64_t. With 32-bit indices every stored edge
+ *  takes half the memory, so it should be preferred unless the graph has
+ *  more than 2^32 vertices.
+ */
+template<
+    typename label_t,
+    typename weight_t = void,
+    typename index_t = uint32_t,
+    typename allocator_t = std::allocator<char>
+>
+class Graph {
+protected:
+    typedef utils::edge_key<index_t> key;
+    typedef typename key::type key_t;
+
+    size_t vertices_no;
+    Labeler<label_t>& labeler;
+    Weighter<weight_t>& weighter;
+
+    typedef typename std::allocator_traits<allocator_t>::template rebind_alloc<key_t> key_allocator_t;
+    typedef btree::btree_set<key_t, std::less<key_t>, key_allocator_t> edge_set_t;
+
+    edge_set_t adj_list;
+
+    // Coordinates of the vertices, set by build_geometric and build_grid
+    Points points;
+
+    // The ranks of the edges, for each ranking (see TriangularRanking and
+    // SquareRanking). An index is only built the first time it is needed,
+    // and then kept up to date as edges are inserted.
+    RankIndex rank_index[2];
+
+    // The weights assigned by assign_weights or assign_distinct_weights.
+    // They are dropped when the edges change.
+    utils::WeightColumn<key_t, weight_t> weight_column;
+
+    // The connected components, weakly connected for directed graphs. They
+    // are only built the first time they are needed; if tracking_components
+    // is set, they are then kept up to date as edges are inserted.
+    ComponentSet components;
+    bool components_built = false;
+    bool tracking_components = false;
+
+    /**
+     *  Returns the connected components, building them if needed
+     */
+    ComponentSet& get_components() {
+        if (!components_built) {
+            components = ComponentSet(vertices_no);
+            for (key_t k: adj_list) {
+                edge_t e = key::unpack(k);
+                if (!is_undirected() || e.tail > e.head)
+                    components.merge(e.tail, e.head);
+            }
+            components_built = true;
+        }
+        return components;
+    }
+
+    /**
+     *  Updates the components after the insertion of the given keys
+     */
+    template<typename It>
+    void merge_components(It begin, It end) {
+        if (!components_built) return;
+        if (!tracking_components) {
+            components_built = false;
+            return;
+        }
+        for (It it = begin; it != end; ++it) {
+            edge_t e = key::unpack(*it);
+            components.merge(e.tail, e.head);
+        }
+    }
+
+    /**
+     *  Returns the index of the given ranking, building it if needed.
+     *  The rankings follow the order of the edges, so the ranks come out
+     *  already sorted from a scan of adj_list.
+     */
+    template<typename Ranking>
+    RankIndex& get_rank_index() {
+        RankIndex& index = rank_index[Ranking::id];
+        if (!index.is_built()) {
+            GRAPHGEN_PHASE(RANK_INDEX);
+            std::vector<uint64_t> ranks;
+            for (key_t k: adj_list) {
+                edge_t e = key::unpack(k);
+                if (Ranking::is_valid(e))
+                    ranks.push_back(Ranking::edge_to_rank(e, vertices_no));
+            }
+            index.build(std::move(ranks));
+        }
+        return index;
+    }
+
+    /**
+     *  Creates edges_no random edges among the ones that are valid for the
+     *  given ranking. The existing edges are excluded using the rank index,
+     *  so the cost does not depend on the number of edges in the graph.
+     */
+    template<typename Ranking>
+    void add_random_edges(const size_t edges_no) {
+        std::vector<edge_t> edges;
+        edges.reserve(edges_no);
+        utils::ScratchScope scope;
+        RangeSampler sampler(
+            edges_no,
+            0,
+            Ranking::max_edges(vertices_no),
+            get_rank_index<Ranking>(),
+            RangeSampler::allocator_type(&utils::scratch_arena())
+        );
+        for (auto r: sampler)
+            edges.push_back(Ranking::rank_to_edge(r, vertices_no));
+        add_edge_list(std::move(edges));
+    }
+
+    /**
+     *  Inserts a single edge, and returns true if it was not already there
+     */
+    bool insert_key(const key_t k) {
+        if (!adj_list.insert(k).second) {
+            GRAPHGEN_COUNT(DUPLICATES_REJECTED, 1);
+            return false;
+        }
+        GRAPHGEN_COUNT(EDGES_INSERTED, 1);
+        GRAPHGEN_MAX(PEAK_EDGE_STORE_BYTES, adj_list.size() * sizeof(key_t));
+        weight_column.clear();
+        merge_components(&k, &k + 1);
+        edge_t e = key::unpack(k);
+        if (rank_index[TriangularRanking::id].is_built() && TriangularRanking::is_valid(e))
+            rank_index[TriangularRanking::id].add(TriangularRanking::edge_to_rank(e, vertices_no));
+        if (rank_index[SquareRanking::id].is_built() && SquareRanking::is_valid(e))
+            rank_index[SquareRanking::id].add(SquareRanking::edge_to_rank(e, vertices_no));
+        return true;
+    }
+
+    /**
+     *  Sorts the given keys and inserts them in adj_list
+     */
+    void insert_keys(std::vector<key_t>& keys) {
+        utils::sort_keys(keys);
+        insert_sorted_keys(keys);
+    }
+
+    /**
+     *  Inserts the given keys, which must already be sorted, in adj_list
+     */
+    void insert_sorted_keys(const std::vector<key_t>& keys) {
+        GRAPHGEN_PHASE(INSERT);
+        const size_t before = adj_list.size();
+        if (!keys.empty())
+            weight_column.clear();
+        merge_components(keys.begin(), keys.end());
+        bool indexed = rank_index[0].is_built() || rank_index[1].is_built();
+        if (!indexed) {
+            adj_list.insert(keys.begin(), keys.end());
+            record_inserts(keys.size(), before);
+            return;
+        }
+        // Since the keys are sorted, the ranks of the new ones are too
+        std::vector<uint64_t> triangular, square;
+        for (key_t k: keys) {
+            size_t before = adj_list.size();
+            adj_list.insert(k);
+            if (adj_list.size() == before) continue;
+            edge_t e = key::unpack(k);
+            if (TriangularRanking::is_valid(e))
+                triangular.push_back(TriangularRanking::edge_to_rank(e, vertices_no));
+            if (SquareRanking::is_valid(e))
+                square.push_back(SquareRanking::edge_to_rank(e, vertices_no));
+        }
+        if (rank_index[TriangularRanking::id].is_built())
+            rank_index[TriangularRanking::id].add_run(std::move(triangular));
+        if (rank_index[SquareRanking::id].is_built())
+            rank_index[SquareRanking::id].add_run(std::move(square));
+        record_inserts(keys.size(), before);
+    }
+
+    /**
+     *  Updates the statistics after inserting requested keys in adj_list,
+     *  which had before keys. Undirected edges count as two keys.
+     */
+    void record_inserts(const size_t requested, const size_t before) const {
+        GRAPHGEN_COUNT(EDGES_INSERTED, adj_list.size() - before);
+        GRAPHGEN_COUNT(DUPLICATES_REJECTED, requested - (adj_list.size() - before));
+        GRAPHGEN_MAX(PEAK_EDGE_STORE_BYTES, adj_list.size() * sizeof(key_t));
+    }
+
+    /**
+     *  Inserts the edges of a structured graph all at once. degree(v) is
+     *  the number of edges with tail v, and heads(v, out) writes their
+     *  heads to out in increasing order, so that the keys are produced
+     *  already sorted. The rows are filled in parallel.
+     */
+    template<typename Degree, typename Heads>
+    void insert_rows(Degree degree, Heads heads) {
+        if (vertices_no == 0) return;
+        std::vector<size_t> offset(vertices_no + 1, 0);
+        for (vertex_t v = 0; v < vertices_no; v++)
+            offset[v+1] = offset[v] + degree(v);
+
+        std::vector<key_t> keys(offset[vertices_no]);
+        size_t grain = std::max<size_t>(1, (1 << 14) / (keys.size() / vertices_no + 1));
+        utils::parallel_for(vertices_no, [&](size_t begin, size_t end) {
+            std::vector<vertex_t> row;
+            for (vertex_t v = begin; v < end; v++) {
+                row.resize(offset[v+1] - offset[v]);
+                if (row.empty()) continue;
+                heads(v, row.data());
+                for (size_t i = 0; i < row.size(); i++)
+                    keys[offset[v] + i] = key::pack({v, row[i]});
+            }
+        }, grain);
+        insert_sorted_keys(keys);
+    }
+
+    /**
+     *  Tells whether add_edge also adds the reverse edge. The structured
+     *  builders use it to produce the rows of the adjacency directly.
+     */
+    virtual bool is_undirected() const {
+        return false;
+    }
+
+    /**
+     *  Must be called after any change to adj_list that is not done by
+     *  insert_key or insert_keys, or to the number of vertices.
+     */
+    void edges_changed() {
+        for (RankIndex& index: rank_index)
+            index.clear();
+        weight_column.clear();
+        components_built = false;
+    }
+
+    /**
+     *  Tells whether an edge is written in the output: undirected graphs
+     *  store both orientations of each edge, but only write one.
+     */
+    bool is_output_edge(const edge_t& e) const {
+        return is_undirected() ? e.tail > e.head : e.tail != e.head;
+    }
+
+    /**
+     *  Returns the edges that are written in the output, in sorted order,
+     *  packed as for verifier
+     */
+    std::vector<uint64_t> fingerprint_keys() const {
+        std::vector<uint64_t> keys;
+        for (key_t k: adj_list) {
+            edge_t e = key::unpack(k);
+            if (is_output_edge(e))
+                keys.push_back(verifier::pack(e.tail, e.head));
+        }
+        return keys;
+    }
+
+    /**
+     *  Returns the sorted keys of the edges that are written in the output
+     */
+    std::vector<key_t> output_keys() const {
+        std::vector<key_t> keys;
+        for (key_t k: adj_list)
+            if (is_output_edge(key::unpack(k)))
+                keys.push_back(k);
+        return keys;
+    }
+
+    void check_vertices_no(const size_t vertices_no) const {
+        if (vertices_no > 0 &&
+            vertices_no - 1 > size_t(std::numeric_limits<index_t>::max()))
+            throw TooManyNodesException();
+    }
+
+    /**
+     *  Throws NoSuchVertexException if an endpoint of the edge is not a
+     *  vertex of the graph, which key::pack would silently truncate
+     */
+    void check_edge(const edge_t& e) const {
+        if (e.tail >= vertices_no || e.head >= vertices_no)
+            throw NoSuchVertexException();
+    }
+
+    /**
+     *  Writes the edges for which is_valid is true, in random order.
+     *
+     *  The edges are split in blocks, which are formatted in parallel by
+     *  worker threads and then written in order, so the output is the same
+     *  as if everything was done by a single thread.
+     */
+    void _write(
+        std::ostream& os,
+        const std::function<bool(const edge_t)> is_valid
+    ) const {
+        if (!weight_column.empty()) {
+            // The stored weights are aligned with the sorted edges, so we
+            // shuffle the positions instead of the edges themselves
+            std::vector<size_t> order(weight_column.keys.size());
+            std::iota(order.begin(), order.end(), 0);
+            Random::shuffle(order.begin(), order.end());
+            os << vertices_no << " " << order.size() << "\n";
+            _write_edges(os, weight_column.keys, &order);
+            return;
+        }
+        utils::ScratchScope scope;
+        auto valid_edges = utils::make_scratch_vector<key_t>();
+        for (key_t k: adj_list)
+            if (is_valid(key::unpack(k)))
+                valid_edges.push_back(k);
+        Random::shuffle(valid_edges.begin(), valid_edges.end());
+        os << vertices_no << " " << valid_edges.size() << "\n";
+        _write_edges(os, valid_edges);
+    }
+
+    /**
+     *  Writes the given edges, one per line, in the given order. If order
+     *  is given, the i-th edge written is valid_edges[order[i]], and its
+     *  weight is taken from weight_column, which must be aligned with
+     *  valid_edges.
+     */
+    template<typename Keys>
+    void _write_edges(
+        std::ostream& os,
+        const Keys& valid_edges,
+        const std::vector<size_t>* order = nullptr
+    ) const {
+        struct block_t {
+            std::vector<edge_t> edges;
+            utils::WeightBlock<weight_t> weights;
+            std::string text;
+        };
+        const size_t block_size = 1 << 14;
+        const size_t blocks_no = (valid_edges.size() + block_size - 1) / block_size;
+        const size_t workers = labeler.is_thread_safe() ? utils::threads_no() - 1 : 0;
+        const bool parallel_weights = workers > 0 && weighter.is_thread_safe();
+        std::vector<block_t> blocks(std::max<size_t>(1, 2 * workers));
+
+        auto prepare = [&](size_t i) {
+            block_t& b = blocks[i % blocks.size()];
+            size_t begin = i * block_size;
+            size_t end = std::min(valid_edges.size(), begin + block_size);
+            b.edges.resize(end - begin);
+            if (order) {
+                for (size_t j = begin; j < end; j++)
+                    b.edges[j - begin] = key::unpack(valid_edges[(*order)[j]]);
+                b.weights.copy(weight_column, order->data() + begin, end - begin);
+                return;
+            }
+            for (size_t j = begin; j < end; j++)
+                b.edges[j - begin] = key::unpack(valid_edges[j]);
+            if (!parallel_weights)
+                b.weights.compute(weighter, b.edges);
+        };
+        auto produce = [&](size_t i) {
+            GRAPHGEN_PHASE(FORMAT);
+            block_t& b = blocks[i % blocks.size()];
+            if (parallel_weights && !order)
+                b.weights.compute(weighter, b.edges);
+            b.text.clear();
+            for (size_t j = 0; j < b.edges.size(); j++) {
+                utils::append_value(b.text, labeler(b.edges[j].tail));
+                b.text += ' ';
+                utils::append_value(b.text, labeler(b.edges[j].head));
+                b.weights.append(b.text, j);
+                b.text += '\n';
+            }
+        };
+        auto consume = [&](size_t i) {
+            GRAPHGEN_PHASE(WRITE);
+            const std::string& text = blocks[i % blocks.size()].text;
+            os.write(text.data(), text.size());
+            GRAPHGEN_COUNT(BYTES_WRITTEN, text.size());
+        };
+        utils::ordered_pipeline(
+            blocks_no, prepare, produce, consume,
+            workers, blocks.size()
+        );
+    }
+
+    /**
+     *  Writes the graph together with edges_no new random edges, which are
+     *  never all kept in memory at the same time, so that graphs much
+     *  larger than the available RAM can be generated.
+     *
+     *  The samples of RangeSampler are generated in sorted runs that are
+     *  spilled to temporary files, and then merged together and with the
+     *  ranks of the existing edges. The resulting edges are scattered among
+     *  temporary bucket files at random, and each bucket is then loaded,
+     *  shuffled and written, which gives a uniformly random order.
+     *
+     *  @param memory_budget  the approximate amount of memory, in bytes,
+     *                        that the temporary data can use
+     *
+     *  The new edges are chosen among the valid ones for the given ranking.
+     */
+    template<typename Ranking>
+    void _write_with_random_edges(
+        std::ostream& os,
+        const size_t edges_no,
+        const size_t memory_budget
+    ) const {
+        // The ranks come out sorted, since the ranking follows the edges
+        utils::ScratchScope scope;
+        auto excluded_ranks = utils::make_scratch_vector<uint64_t>();
+        for (key_t k: adj_list) {
+            edge_t e = key::unpack(k);
+            if (Ranking::is_valid(e))
+                excluded_ranks.push_back(Ranking::edge_to_rank(e, vertices_no));
+        }
+        const uint64_t max_edges = Ranking::max_edges(vertices_no);
+        if (max_edges < edges_no + excluded_ranks.size())
+            throw TooManySamplesException();
+        const uint64_t top = max_edges - edges_no - excluded_ranks.size() + 1;
+
+        // Each run is sorted in memory, and radix sort needs twice its size
+        const size_t chunk = std::max<size_t>(1 << 16, memory_budget / 4 / sizeof(uint64_t));
+
+        std::vector<std::unique_ptr<utils::TempFile>> runs;
+        std::vector<uint64_t> run;
+        for (size_t done = 0; done < edges_no; done += run.size()) {
+            run.resize(std::min(chunk, edges_no - done));
+            for (uint64_t& r: run)
+                r = Random::randrange(uint64_t(0), top);
+            utils::sort_keys(run);
+            runs.emplace_back(new utils::TempFile());
+            runs.back()->push(run.data(), run.data() + run.size());
+            runs.back()->rewind();
+        }
+        std::vector<uint64_t>().swap(run);
+
+        // Every edge goes to a random bucket, and a bucket is expected to
+        // contain at most chunk edges
+        const size_t total = edges_no + excluded_ranks.size();
+        const size_t buckets_no = total / chunk + 1;
+        std::vector<std::unique_ptr<utils::TempFile>> buckets;
+        for (size_t b = 0; b < buckets_no; b++)
+            buckets.emplace_back(new utils::TempFile());
+        auto scatter = [&](const uint64_t rank) {
+            buckets[Random::randrange(size_t(0), buckets_no)]->push(rank);
+        };
+
+        // k-way merge of the runs. As in RangeSampler, the i-th smallest
+        // sample is shifted by i plus the number of excluded ranks before it.
+        typedef std::pair<uint64_t, size_t> head_t;
+        std::priority_queue<head_t, std::vector<head_t>, std::greater<head_t>> heads;
+        for (size_t i = 0; i < runs.size(); i++) {
+            uint64_t v;
+            if (runs[i]->next(v))
+                heads.push({v, i});
+        }
+        size_t excl_idx = 0;
+        for (uint64_t i = 0; !heads.empty(); i++) {
+            head_t h = heads.top();
+            heads.pop();
+            while (excl_idx < excluded_ranks.size() &&
+                   excluded_ranks[excl_idx] <= h.first + i + excl_idx)
+                excl_idx++;
+            scatter(h.first + i + excl_idx);
+            uint64_t v;
+            if (runs[h.second]->next(v))
+                heads.push({v, h.second});
+        }
+        runs.clear();
+        for (uint64_t r: excluded_ranks)
+            scatter(r);
+
+        os << vertices_no << " " << total << "\n";
+        std::vector<key_t> edges;
+        for (auto& bucket: buckets) {
+            bucket->rewind();
+            edges.clear();
+            uint64_t r;
+            while (bucket->next(r))
+                edges.push_back(key::pack(Ranking::rank_to_edge(r, vertices_no)));
+            bucket.reset();
+            Random::shuffle(edges.begin(), edges.end());
+            _write_edges(os, edges);
+        }
     }
-};
 
-/**
- *  RangeSampler provides iterators for ranging over sampled integers
- *  in a given range.
- */
-class RangeSampler {
-private:
-    std::vector<int64_t> samples;
+    /**
+     *  Keeps only edges_no random edges among the ones for which is_valid
+     *  is true, and drops all the others.
+     */
+    void _sample_edges(
+        const size_t edges_no,
+        const std::function<bool(const edge_t)> is_valid
+    ) {
+        size_t valid_no = 0;
+        for (key_t k: adj_list)
+            valid_no += is_valid(key::unpack(k));
+        if (edges_no > valid_no)
+            throw TooManyEdgesException();
+
+        // The sampled positions come out sorted, so a single scan of the
+        // valid edges in order is enough to pick them.
+        std::vector<edge_t> kept;
+        kept.reserve(edges_no);
+        utils::ScratchScope scope;
+        RangeSampler sampler(
+            edges_no, 0, valid_no, {},
+            RangeSampler::allocator_type(&utils::scratch_arena())
+        );
+        auto next = sampler.begin();
+        int64_t position = 0;
+        for (key_t k: adj_list) {
+            if (next == sampler.end()) break;
+            edge_t e = key::unpack(k);
+            if (!is_valid(e)) continue;
+            if (position++ == *next) {
+                kept.push_back(e);
+                ++next;
+            }
+        }
+        adj_list.clear();
+        edges_changed();
+        add_edge_list(std::move(kept));
+    }
 
 public:
     /**
-     *  The constructor generates the samples from the range [min, max].
+     *  Initialize the graph
      *
-     *  @param sample_size the number of samples
-     *  @param min the min of the range
-     *  @param max the max of the range
-     *  @param excl an optional vector of undesired values
+     *  @param vertices_no number of vertices of the graph
+     *  @param alloc allocator of the edges; copies of the graph share it
      */
-    RangeSampler(
-        const size_t sample_size,
-        const int64_t min,
-        const int64_t max,
-        std::vector<int64_t> excl = std::vector<int64_t>()
-    ) {
-        if (!std::is_sorted(excl.begin(), excl.end()))
-            std::sort(excl.begin(), excl.end());
+    Graph(
+        const size_t vertices_no,
+        Labeler<label_t>& labeler,
+        Weighter<weight_t>& weighter,
+        const allocator_t& alloc = allocator_t()
+    ): vertices_no(vertices_no), labeler(labeler), weighter(weighter),
+       adj_list(std::less<key_t>(), key_allocator_t(alloc)) {
+        check_vertices_no(vertices_no);
+    }
 
-        // If the user requests too many samples, throw
-        if (max - min < int64_t(sample_size + excl.size()))
-            throw TooManySamplesException();
+    virtual ~Graph() {};
 
-        auto top = max - sample_size - excl.size() + 1;
-        samples.resize(sample_size);
-        for (size_t i = 0; i < sample_size; i++)
-            samples[i] = Random::randrange(min, top);
+    // Interface methods
+    virtual void add_edge(const vertex_t a, const vertex_t b) = 0;
+    virtual void write(std::ostream& os) const = 0;
+    virtual void connect() = 0;
 
-        // TODO: Is counting sort better than std::sort here?
-        std::sort(samples.begin(), samples.end());
-        size_t excl_idx = 0;
-        for (size_t i = 0; i < sample_size; i++) {
-            while (excl_idx < excl.size() &&
-                   excl[excl_idx] <= samples[i] + int64_t(i + excl_idx))
-                excl_idx++;
-            samples[i] += i + excl_idx;
-        }
+    size_t get_vertices_no() const {
+        return vertices_no;
     }
 
-    std::vector<int64_t>::iterator begin() {
-        return samples.begin();
+    /**
+     *  Enables or disables keeping the connected components up to date
+     *  while edges are inserted, so that connect, component_count and
+     *  same_component do not scan the graph. Any other change to the
+     *  edges still makes the next query rebuild them.
+     */
+    void track_components(const bool enable = true) {
+        tracking_components = enable;
     }
 
-    std::vector<int64_t>::iterator end() {
-        return samples.end();
+    /**
+     *  Returns the number of connected components, weakly connected for
+     *  directed graphs
+     */
+    size_t component_count() {
+        return get_components().count();
     }
-};
 
-/**
- *  Graph is an abstract class
- */
-template<typename label_t, typename weight_t = void>
-class Graph {
-protected:
-    size_t vertices_no;
-    Labeler<label_t>& labeler;
-    Weighter<weight_t>& weighter;
+    bool same_component(const vertex_t a, const vertex_t b) {
+        if (a >= vertices_no || b >= vertices_no)
+            throw std::out_of_range("No such vertex");
+        ComponentSet& c = get_components();
+        return c.find(a) == c.find(b);
+    }
+
+    std::string to_string() const {
+        std::ostringstream oss;
+        write(oss);
+        return oss.str();
+    }
 
-    btree::btree_set<edge_t> adj_list;
+    /**
+     *  Writes the graph like write, but with the given edges in the given
+     *  order and orientation instead of a random one, for inputs whose
+     *  difficulty depends on the order of the edges. Each edge must be in
+     *  the graph. If the graph has stored weights, undirected edges are
+     *  written with the same orientation as write.
+     */
+    void write_in_order(std::ostream& os, const std::vector<edge_t>& edges) const {
+        std::vector<key_t> keys(edges.size());
+        for (size_t i = 0; i < edges.size(); i++) {
+            keys[i] = key::pack(edges[i]);
+            if (adj_list.find(keys[i]) == adj_list.end())
+                throw NoSuchEdgeException();
+        }
+        os << vertices_no << " " << keys.size() << "\n";
+        if (weight_column.empty()) {
+            _write_edges(os, keys);
+            return;
+        }
+        std::vector<size_t> order(edges.size());
+        for (size_t i = 0; i < edges.size(); i++) {
+            edge_t e = edges[i];
+            if (is_undirected() && e.tail < e.head)
+                std::swap(e.tail, e.head);
+            order[i] = weight_column.find(key::pack(e));
+        }
+        _write_edges(os, weight_column.keys, &order);
+    }
 
     /**
-     *  Creates random edges
+     *  Writes the graph as write does, followed by the number of
+     *  operations and operations_no operations on it, one per line:
+     *  "+ a b" inserts an edge that is not in the graph, with a weight from
+     *  the weighter if the graph is weighted, "- a b" removes an edge of
+     *  the graph and "? a b" asks whether a and b are connected, weakly
+     *  for directed graphs. The answers are written to answers, one per
+     *  query, as 1 or 0. The graph itself is not changed.
      *
-     *  @param edges_no      number of edges to be created
+     *  The kind of each operation is random, with probabilities
+     *  proportional to inserts, removes and queries; an insertion in a
+     *  complete graph becomes a removal, and a removal from an empty graph
+     *  an insertion. The edges to insert are uniformly random among the
+     *  missing ones, found by rejection, so they get slow when the graph
+     *  is almost complete; the edges to remove are uniformly random among
+     *  the present ones, and the queries among the pairs of vertices.
      *
-     *  @param max_edges     the maximum number of edges in the graph
+     *  The operations are generated in blocks of at least N + M of them,
+     *  which are written and then answered offline (see
+     *  updates::OfflineConnectivity), so the memory used does not depend
+     *  on operations_no.
+     */
+    void write_updates(
+        std::ostream& os,
+        std::ostream& answers,
+        const size_t operations_no,
+        const double inserts = 1,
+        const double removes = 1,
+        const double queries = 1
+    ) const {
+        if (inserts < 0 || removes < 0 || queries < 0 || inserts + removes + queries <= 0)
+            throw std::invalid_argument("The ratios must be non-negative and not all zero");
+        if (operations_no > 0 && vertices_no < 2)
+            throw TooFewNodesException();
+        const bool undirected = is_undirected();
+        const uint64_t max_edges = uint64_t(vertices_no) * (vertices_no - 1) / (undirected ? 2 : 1);
+
+        write(os);
+        os << operations_no << "\n";
+
+        EdgeStore edges;
+        for (uint64_t k: fingerprint_keys())
+            edges.insert(k);
+
+        auto random_pair = [&]() {
+            vertex_t a = Random::randrange(vertex_t(0), vertex_t(vertices_no));
+            vertex_t b = Random::randrange(vertex_t(0), vertex_t(vertices_no - 1));
+            if (b >= a) b++;
+            if (undirected && a < b) std::swap(a, b);
+            return verifier::pack(a, b);
+        };
+
+        updates::OfflineConnectivity oracle(vertices_no);
+        std::vector<updates::operation_t> block;
+        std::vector<edge_t> inserted;
+        utils::WeightBlock<weight_t> weights;
+        std::string text;
+        auto flush = [&](std::ostream& out) {
+            out.write(text.data(), text.size());
+            GRAPHGEN_COUNT(BYTES_WRITTEN, text.size());
+            text.clear();
+        };
+        for (size_t done = 0; done < operations_no; done += block.size()) {
+            // Blocks as large as the graph amortize merging its untouched edges
+            const size_t block_size = std::min(
+                operations_no - done,
+                std::max<size_t>(1 << 16, std::min<size_t>(1 << 30, vertices_no + edges.size()))
+            );
+            block.clear();
+            inserted.clear();
+            for (size_t i = 0; i < block_size; i++) {
+                double r = Random::randrange(0.0, inserts + removes + queries);
+                updates::kind_t kind = r < inserts ? updates::INSERT
+                                     : r < inserts + removes ? updates::REMOVE
+                                     : updates::QUERY;
+                if (kind == updates::INSERT && edges.size() == max_edges)
+                    kind = updates::REMOVE;
+                else if (kind == updates::REMOVE && edges.empty())
+                    kind = updates::INSERT;
+                uint64_t k;
+                if (kind == updates::QUERY) {
+                    k = random_pair();
+                } else if (kind == updates::REMOVE) {
+                    k = edges.random();
+                    edges.erase(k);
+                } else {
+                    do k = random_pair(); while (!edges.insert(k));
+                    inserted.push_back(updates::unpack(k));
+                }
+                block.push_back({k, kind});
+            }
+
+            weights.compute(weighter, inserted);
+            for (size_t i = 0, j = 0; i < block.size(); i++) {
+                edge_t e = updates::unpack(block[i].edge);
+                text += "+-?"[block[i].kind];
+                text += ' ';
+                utils::append_value(text, labeler(e.tail));
+                text += ' ';
+                utils::append_value(text, labeler(e.head));
+                if (block[i].kind == updates::INSERT)
+                    weights.append(text, j++);
+                text += '\n';
+                if (text.size() >= (1 << 20))
+                    flush(os);
+            }
+            flush(os);
+
+            for (bool connected: oracle.answer(edges.get_keys(), block))
+                text += connected ? "1\n" : "0\n";
+            flush(answers);
+        }
+    }
+
+    /**
+     *  Checks that the graph has the given properties (see verifier), and
+     *  throws a VerificationException describing the first one that does
+     *  not hold. If edges_no is not negative, also checks that the graph
+     *  has that many edges.
+     */
+    void verify(const unsigned properties, const int64_t edges_no = -1) const {
+        std::vector<uint64_t> keys;
+        for (key_t k: adj_list) {
+            edge_t e = key::unpack(k);
+            if (!is_undirected() || e.tail >= e.head)
+                keys.push_back(verifier::pack(e.tail, e.head));
+        }
+        verifier::check(vertices_no, keys, !is_undirected(), properties, edges_no);
+    }
+
+    /**
+     *  Replaces the graph with the one in the given file, in the format
+     *  written by write, whose labels go from first_label to first_label +
+     *  N - 1 as with IotaLabeler(first_label). The file is mapped in
+     *  memory, parsed in parallel and bulk-loaded; its weights are ignored.
+     */
+    void load(const std::string& path, const int64_t first_label = 0) {
+        utils::MappedFile file(path);
+        const bool undirected = is_undirected();
+        size_t n;
+        std::vector<key_t> keys = utils::parse_edges<key_t>(
+            file.data(), file.size(), first_label, n,
+            [undirected](vertex_t tail, vertex_t head, const char*, std::vector<key_t>& out) {
+                out.push_back(key::pack({tail, head}));
+                if (undirected && tail != head)
+                    out.push_back(key::pack({head, tail}));
+            }
+        );
+        check_vertices_no(n);
+        vertices_no = n;
+        adj_list.clear();
+        points = Points();
+        edges_changed();
+        insert_keys(keys);
+    }
+
+    virtual void add_edges(const size_t edges_t) = 0;
+    virtual void remove_edge(const vertex_t a, const vertex_t b) = 0;
+    virtual void sample_edges(const size_t edges_no) = 0;
+
+    void add_edge(const edge_t& v) {
+        add_edge(v.tail, v.head);
+    }
+
+    /**
+     *  Adds many edges at once. This is much faster than calling add_edge
+     *  for each of them, since the edges are sorted and inserted in order.
+     */
+    virtual void add_edge_list(std::vector<edge_t> edges) {
+        std::vector<key_t> keys(edges.size());
+        for (size_t i = 0; i < edges.size(); i++) {
+            check_edge(edges[i]);
+            keys[i] = key::pack(edges[i]);
+        }
+        insert_keys(keys);
+    }
+
+    /**
+     *  Removes many edges at once, with a single pass over the graph.
+     */
+    virtual void remove_edge_list(std::vector<edge_t> edges) {
+        std::vector<key_t> keys(edges.size());
+        for (size_t i = 0; i < edges.size(); i++)
+            keys[i] = key::pack(edges[i]);
+        utils::sort_keys(keys);
+        edge_set_t res(adj_list.key_comp(), adj_list.get_allocator());
+        std::set_difference(
+            adj_list.begin(), adj_list.end(),
+            keys.begin(), keys.end(),
+            std::inserter(res, res.end())
+        );
+        adj_list.swap(res);
+        edges_changed();
+    }
+
+    /**
+     *  Replaces the graph with the subgraph induced by the given vertices.
+     *  The i-th of them becomes vertex i of the new graph; repeated
+     *  vertices are ignored.
+     */
+    void induced_subgraph(const std::vector<vertex_t>& vertices) {
+        const vertex_t none = std::numeric_limits<vertex_t>::max();
+        std::vector<vertex_t> new_id(vertices_no, none);
+        size_t new_vertices_no = 0;
+        for (vertex_t v: vertices) {
+            if (v >= vertices_no)
+                throw TooFewNodesException();
+            if (new_id[v] == none)
+                new_id[v] = new_vertices_no++;
+        }
+
+        std::vector<key_t> keys;
+        for (key_t k: adj_list) {
+            edge_t e = key::unpack(k);
+            if (e.tail >= vertices_no || e.head >= vertices_no) continue;
+            if (new_id[e.tail] != none && new_id[e.head] != none)
+                keys.push_back(key::pack({new_id[e.tail], new_id[e.head]}));
+        }
+        adj_list.clear();
+        edges_changed();
+        insert_keys(keys);
+
+        if (points.size() == vertices_no) {
+            Points new_points;
+            new_points.resize(new_vertices_no);
+            for (vertex_t v = 0; v < vertices_no; v++) {
+                if (new_id[v] == none) continue;
+                new_points.x[new_id[v]] = points.x[v];
+                new_points.y[new_id[v]] = points.y[v];
+            }
+            points = new_points;
+        }
+        vertices_no = new_vertices_no;
+    }
+
+    /**
+     *  Returns the coordinates of the vertices. They are only available
+     *  after a call to build_geometric or build_grid.
+     */
+    const Points& get_points() const {
+        return points;
+    }
+
+    /**
+     *  Computes the weights of all the edges with the weighter and stores
+     *  them, so that the graph is always written with the same weights and
+     *  they can be read with get_weight. The stored weights are dropped as
+     *  soon as the edges of the graph change.
+     */
+    void assign_weights() {
+        static_assert(!std::is_void<weight_t>::value, "The graph has no weights");
+        assign_weights(weighter);
+    }
+
+    /**
+     *  Same as assign_weights, but the weights are computed with the given
+     *  weighter instead of the one of the graph
+     */
+    void assign_weights(Weighter<weight_t>& w) {
+        std::vector<key_t> keys = output_keys();
+        std::vector<weight_t> values(keys.size());
+        auto compute = [&](size_t begin, size_t end) {
+            std::vector<edge_t> edges(end - begin);
+            for (size_t i = begin; i < end; i++)
+                edges[i - begin] = key::unpack(keys[i]);
+            w(edges.data(), edges.size(), values.data() + begin);
+        };
+        if (w.is_thread_safe())
+            utils::parallel_for(keys.size(), compute);
+        else
+            compute(0, keys.size());
+        weight_column.keys.swap(keys);
+        weight_column.values.swap(values);
+    }
+
+    /**
+     *  Same as assign_weights, but the weight of each edge is the distance
+     *  between its endpoints times scale, as given by EuclideanWeighter.
+     *  It needs the coordinates set by build_geometric or build_grid, and
+     *  throws NoPointsException if the vertices have none.
+     */
+    void assign_euclidean_weights(const double scale = 1) {
+        static_assert(!std::is_void<weight_t>::value, "The graph has no weights");
+        if (points.size() != vertices_no)
+            throw NoPointsException();
+        EuclideanWeighter<weight_t> euclidean(points, scale);
+        assign_weights(euclidean);
+    }
+
+    /**
+     *  Same as assign_weights, but the weights are pairwise distinct
+     *  integers in the range [min, max), chosen at random. This gives, for
+     *  example, graphs with a unique minimum spanning tree.
+     */
+    template<typename T = weight_t>
+    void assign_distinct_weights(const T min, const T max) {
+        static_assert(std::is_integral<T>::value, "Distinct weights must be integers");
+        std::vector<key_t> keys = output_keys();
+        RangeSampler sampler(keys.size(), min, max);
+        std::vector<weight_t> values(sampler.begin(), sampler.end());
+        Random::shuffle(values.begin(), values.end());
+        weight_column.keys.swap(keys);
+        weight_column.values.swap(values);
+    }
+
+    /**
+     *  Tells whether the graph has stored weights
+     */
+    bool has_weights() const {
+        return !weight_column.empty();
+    }
+
+    /**
+     *  Returns the stored weight of an edge
+     */
+    weight_t get_weight(vertex_t tail, vertex_t head) const {
+        if (weight_column.empty())
+            throw NoWeightsException();
+        if (is_undirected() && tail < head)
+            std::swap(tail, head);
+        size_t pos = weight_column.find(key::pack({tail, head}));
+        if (pos == weight_column.keys.size())
+            throw NoSuchEdgeException();
+        return weight_column.values[pos];
+    }
+
+    /**
+     *  Returns a 128-bit hash of the graph that does not depend on the
+     *  order of the edges (see fingerprints::of_edges), to find duplicate
+     *  test cases. The stored weights, if any, are included. It is the
+     *  hash that fingerprint.cpp computes on the written graph, when the
+     *  labels are the indices of the vertices plus a constant.
+     */
+    fingerprints::value_t fingerprint() const {
+        return fingerprints::of_edges(
+            vertices_no, fingerprint_keys(), weight_column.hash_values(), !is_undirected()
+        );
+    }
+
+    /**
+     *  Returns a 128-bit hash of the graph that is the same for isomorphic
+     *  graphs, whatever their labels (see fingerprints::invariant).
+     */
+    fingerprints::value_t invariant_fingerprint(const size_t rounds = 3) const {
+        return fingerprints::invariant(
+            vertices_no, fingerprint_keys(), weight_column.hash_values(),
+            !is_undirected(), rounds
+        );
+    }
+
+    /**
+     *  Returns a snapshot of the edges that are written in the output, in
+     *  sorted order, as consecutive pairs of vertex indices (tail, head).
+     *  The stored weights, if any, are in the same order.
+     */
+    std::vector<index_t> edge_array() const {
+        std::vector<key_t> keys = output_keys();
+        std::vector<index_t> res(2 * keys.size());
+        utils::parallel_for(keys.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                edge_t e = key::unpack(keys[i]);
+                res[2*i] = e.tail;
+                res[2*i + 1] = e.head;
+            }
+        });
+        return res;
+    }
+
+    /**
+     *  Returns a copy of the stored weights, in the order of edge_array,
+     *  or an empty vector if the graph has no stored weights
+     */
+    std::vector<weight_t> weight_array() const {
+        static_assert(!std::is_void<weight_t>::value, "The graph has no weights");
+        return weight_column.values;
+    }
+
+    /**
+     *  Returns the degree of every vertex, counting the edges that are
+     *  written in the output. For directed graphs these are the
+     *  out-degrees, or the in-degrees if in is true.
+     */
+    std::vector<index_t> degree_array(const bool in = false) const {
+        std::vector<index_t> res(vertices_no, 0);
+        for (key_t k: adj_list) {
+            edge_t e = key::unpack(k);
+            if (e.tail != e.head)
+                res[in ? e.head : e.tail]++;
+        }
+        return res;
+    }
+
+    void build_forest(size_t edges_no) {
+        if (edges_no > vertices_no - 1)
+            throw TooManyEdgesException();
+        // Each sampled vertex v gets a random parent in [0, v]
+        RangeSampler sampler(edges_no, 0, vertices_no-1);
+        std::vector<vertex_t> heads(sampler.begin(), sampler.end()), tails(edges_no);
+        for (vertex_t& v: heads)
+            v++;
+        Random::fill_below(tails.data(), heads.data(), edges_no);
+        std::vector<edge_t> edges(edges_no);
+        for (size_t i = 0; i < edges_no; i++)
+            edges[i] = {tails[i], heads[i]};
+        add_edge_list(std::move(edges));
+    }
+
+    void build_path() {
+        const vertex_t last = vertices_no - 1;
+        if (is_undirected()) {
+            insert_rows(
+                [&](vertex_t v) { return (v > 0) + (v < last); },
+                [&](vertex_t v, vertex_t* out) {
+                    if (v > 0) *out++ = v - 1;
+                    if (v < last) *out++ = v + 1;
+                }
+            );
+        } else {
+            insert_rows(
+                [&](vertex_t v) { return v < last; },
+                [&](vertex_t v, vertex_t* out) { *out = v + 1; }
+            );
+        }
+    }
+
+    void build_cycle() {
+        if (vertices_no < 3) {
+            build_path();
+            add_edge(vertices_no - 1, 0);
+            return;
+        }
+        const vertex_t last = vertices_no - 1;
+        if (is_undirected()) {
+            insert_rows(
+                [&](vertex_t) { return 2; },
+                [&](vertex_t v, vertex_t* out) {
+                    if (v == 0) {
+                        out[0] = 1; out[1] = last;
+                    } else if (v == last) {
+                        out[0] = 0; out[1] = last - 1;
+                    } else {
+                        out[0] = v - 1; out[1] = v + 1;
+                    }
+                }
+            );
+        } else {
+            insert_rows(
+                [&](vertex_t) { return 1; },
+                [&](vertex_t v, vertex_t* out) { *out = v == last ? 0 : v + 1; }
+            );
+        }
+    }
+
+    void build_tree() {
+        build_forest(vertices_no - 1);
+    }
+
+    void build_star() {
+        const bool undirected = is_undirected();
+        insert_rows(
+            [&](vertex_t v) -> size_t {
+                return v == 0 ? vertices_no - 1 : undirected;
+            },
+            [&](vertex_t v, vertex_t* out) {
+                if (v != 0) {
+                    *out = 0;
+                    return;
+                }
+                std::iota(out, out + vertices_no - 1, 1);
+            }
+        );
+    }
+
+    /**
+     *  Creates a wheel: vertex 0 is connected to all the others, which
+     *  form a cycle 1, 2, ..., N-1.
+     */
+    void build_wheel() {
+        if (vertices_no < 4) {
+            for(vertex_t i=1; i<vertices_no; i++) {
+                add_edge(i-1, i);
+                add_edge(0, i);
+            }
+            if (vertices_no > 2)
+                add_edge(vertices_no - 1, 1);
+            return;
+        }
+        const vertex_t last = vertices_no - 1;
+        if (is_undirected()) {
+            insert_rows(
+                [&](vertex_t v) -> size_t { return v == 0 ? last : 3; },
+                [&](vertex_t v, vertex_t* out) {
+                    if (v == 0) {
+                        std::iota(out, out + last, 1);
+                    } else if (v == 1) {
+                        out[0] = 0; out[1] = 2; out[2] = last;
+                    } else if (v == last) {
+                        out[0] = 0; out[1] = 1; out[2] = last - 1;
+                    } else {
+                        out[0] = 0; out[1] = v - 1; out[2] = v + 1;
+                    }
+                }
+            );
+        } else {
+            insert_rows(
+                [&](vertex_t v) -> size_t { return v == 0 ? last : 1; },
+                [&](vertex_t v, vertex_t* out) {
+                    if (v == 0)
+                        std::iota(out, out + last, 1);
+                    else
+                        *out = v == last ? 1 : v + 1;
+                }
+            );
+        }
+    }
+
+    void build_clique() {
+        if (is_undirected()) {
+            insert_rows(
+                [&](vertex_t) -> size_t { return vertices_no - 1; },
+                [&](vertex_t v, vertex_t* out) {
+                    std::iota(out, out + v, 0);
+                    std::iota(out + v, out + vertices_no - 1, v + 1);
+                }
+            );
+        } else {
+            insert_rows(
+                [&](vertex_t v) -> size_t { return vertices_no - 1 - v; },
+                [&](vertex_t v, vertex_t* out) {
+                    std::iota(out, out + vertices_no - 1 - v, v + 1);
+                }
+            );
+        }
+    }
+
+    /**
+     *  Creates a random geometric graph: the vertices are random points in
+     *  the unit square, and two vertices are connected if their distance
+     *  is at most radius.
      *
-     *  @param is_valid      this lambda specifies if the edges passed as
-     *                       an argument can be passed to edge_to_rank
-     *  @param edge_to_rank  this lambda takes an edge and returns its rank
-     *                       among all the edges of the graph
-     *  @param rank_to_edge  this lambda takes a number in the range
-     *                       [0, max_edges) and returns an edge that has that
-     *                       number as rank
-     */
-    void add_random_edges(
-        const size_t edges_no,
-        const size_t max_edges,
-        const std::function<bool(const edge_t)> is_valid,
-        const std::function<uint64_t(const edge_t)> edge_to_rank,
-        const std::function<edge_t(const uint64_t)> rank_to_edge
-    ) {
-        // We remove the existing edges from the range of edges that
-        // RangeSampler will choose from.
-        std::vector<int64_t> excluded_ranks;
-        for (edge_t e: adj_list)
-            if (is_valid(e))
-                excluded_ranks.push_back(edge_to_rank(e));
+     *  The points are bucketed in a grid of cells whose side is at least
+     *  radius, so that only pairs of points in neighbouring cells need to be
+     *  checked. The expected running time is O(N + M).
+     */
+    void build_geometric(const double radius) {
+        points.resize(vertices_no);
+        for (vertex_t i = 0; i < vertices_no; i++) {
+            points.x[i] = Random::randrange(0.0, 1.0);
+            points.y[i] = Random::randrange(0.0, 1.0);
+        }
+        if (radius <= 0 || vertices_no == 0)
+            return;
+
+        // Having more cells than points is useless
+        size_t side = std::max(1.0, std::min(
+            std::floor(1 / radius),
+            std::ceil(std::sqrt(vertices_no))
+        ));
+        auto cell_of = [&](const vertex_t v) -> size_t {
+            size_t cx = std::min(side - 1, size_t(points.x[v] * side));
+            size_t cy = std::min(side - 1, size_t(points.y[v] * side));
+            return cy * side + cx;
+        };
+
+        // Counting sort of the points by cell
+        std::vector<size_t> cell_start(side*side + 1);
+        for (vertex_t v = 0; v < vertices_no; v++)
+            cell_start[cell_of(v) + 1]++;
+        std::partial_sum(cell_start.begin(), cell_start.end(), cell_start.begin());
+        std::vector<vertex_t> by_cell(vertices_no);
+        std::vector<size_t> pos(cell_start.begin(), cell_start.end() - 1);
+        for (vertex_t v = 0; v < vertices_no; v++)
+            by_cell[pos[cell_of(v)]++] = v;
+
+        // Every pair of neighbouring cells is visited exactly once
+        const int dirs[][2] = {{0, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+        const double r2 = radius * radius;
+        std::vector<edge_t> edges;
+        for (size_t cy = 0; cy < side; cy++) {
+            for (size_t cx = 0; cx < side; cx++) {
+                size_t a = cy * side + cx;
+                for (auto& d: dirs) {
+                    int64_t nx = cx + d[0], ny = cy + d[1];
+                    if (nx < 0 || nx >= int64_t(side) || ny >= int64_t(side))
+                        continue;
+                    size_t b = ny * side + nx;
+                    for (size_t i = cell_start[a]; i < cell_start[a+1]; i++) {
+                        vertex_t u = by_cell[i];
+                        size_t j = a == b ? i + 1 : cell_start[b];
+                        for (; j < cell_start[b+1]; j++) {
+                            vertex_t v = by_cell[j];
+                            double dx = points.x[u] - points.x[v];
+                            double dy = points.y[u] - points.y[v];
+                            if (dx*dx + dy*dy <= r2)
+                                edges.push_back({std::max(u, v), std::min(u, v)});
+                        }
+                    }
+                }
+            }
+        }
+        add_edge_list(std::move(edges));
+    }
+
+    /**
+     *  Creates a grid with the given number of rows and columns. The vertex
+     *  in row r and column c is r*cols + c. The vertices are also given
+     *  evenly spaced coordinates in the unit square.
+     */
+    void build_grid(const size_t rows, const size_t cols) {
+        if (rows * cols > vertices_no)
+            throw TooFewNodesException();
+        double step = 1.0 / std::max<size_t>(1, std::max(rows, cols) - 1);
+        points.resize(vertices_no);
+        std::vector<edge_t> edges;
+        for (size_t r = 0; r < rows; r++) {
+            for (size_t c = 0; c < cols; c++) {
+                vertex_t v = r * cols + c;
+                points.x[v] = c * step;
+                points.y[v] = r * step;
+                if (c + 1 < cols)
+                    edges.push_back({v, v + 1});
+                if (r + 1 < rows)
+                    edges.push_back({v, v + cols});
+            }
+        }
+        add_edge_list(std::move(edges));
+    }
+
+    // Graph algebra. All these operations work in place and produce the
+    // new edges directly in sorted order, so that each of them is a single
+    // linear pass over the edge sets involved.
 
-        // We now call RangeSampler and scan the sorted samples, adding edges
-        // as we go
-        for (auto r: RangeSampler(edges_no, 0, max_edges, excluded_ranks)) {
-            add_edge(rank_to_edge(r));
+    /**
+     *  Replaces the graph with its complement. The edges of the complement
+     *  are generated row by row while scanning the current ones, so apart
+     *  from the result no O(N^2) structure is ever built.
+     */
+    void complement() {
+        edge_set_t res(adj_list.key_comp(), adj_list.get_allocator());
+        auto it = adj_list.begin();
+        for (vertex_t tail = 0; tail < vertices_no; tail++) {
+            for (vertex_t head = 0; head < vertices_no; head++) {
+                key_t k = key::pack({tail, head});
+                while (it != adj_list.end() && *it < k)
+                    ++it;
+                if (it != adj_list.end() && !(k < *it))
+                    continue;
+                if (head != tail)
+                    res.insert(res.end(), k);
+            }
         }
+        adj_list.swap(res);
+        edges_changed();
     }
 
-    std::string _to_string(
-        const std::function<bool(const edge_t)> is_valid
-    ) const {
-        std::ostringstream oss;
-        std::vector<edge_t> valid_edges;
-        std::copy_if(
-            adj_list.begin(),
-            adj_list.end(),
-            std::back_inserter(valid_edges),
-            is_valid
+    /**
+     *  Adds all the edges of other to the graph. The resulting graph has as
+     *  many vertices as the largest of the two.
+     */
+    void union_with(const Graph<label_t, weight_t, index_t, allocator_t>& other) {
+        edge_set_t res(adj_list.key_comp(), adj_list.get_allocator());
+        std::set_union(
+            adj_list.begin(), adj_list.end(),
+            other.adj_list.begin(), other.adj_list.end(),
+            std::inserter(res, res.end())
         );
-        std::random_shuffle(valid_edges.begin(), valid_edges.end());
-        oss << vertices_no << " " << valid_edges.size() << "\n";
-        for (edge_t e: valid_edges) {
-            oss << labeler(e.tail) << " " << labeler(e.head);
-            utils::write_weight(weighter, e, oss);
-            oss << "\n";
-        }
-        return oss.str();
+        adj_list.swap(res);
+        edges_changed();
+        // The new vertices have no coordinates
+        if (other.vertices_no > vertices_no)
+            points = Points();
+        vertices_no = std::max(vertices_no, other.vertices_no);
     }
 
-public:
     /**
-     *  Initialize the graph
-     *
-     *  @param vertices_no number of vertices of the graph
+     *  Keeps only the edges that also belong to other. The resulting graph
+     *  has as many vertices as the smallest of the two.
      */
-    Graph(
-        const size_t vertices_no,
-        Labeler<label_t>& labeler,
-        Weighter<weight_t>& weighter
-    ): vertices_no(vertices_no), labeler(labeler), weighter(weighter) { }
+    void intersect_with(const Graph<label_t, weight_t, index_t, allocator_t>& other) {
+        edge_set_t res(adj_list.key_comp(), adj_list.get_allocator());
+        std::set_intersection(
+            adj_list.begin(), adj_list.end(),
+            other.adj_list.begin(), other.adj_list.end(),
+            std::inserter(res, res.end())
+        );
+        adj_list.swap(res);
+        edges_changed();
+        vertices_no = std::min(vertices_no, other.vertices_no);
+        if (points.size() > vertices_no)
+            points.resize(vertices_no);
+    }
 
-    virtual ~Graph() {};
+    /**
+     *  Adds a copy of other to the graph, whose vertices are numbered after
+     *  the ones already present.
+     */
+    void disjoint_union_with(const Graph<label_t, weight_t, index_t, allocator_t>& other) {
+        // Copy the edges first, in case other is this graph
+        std::vector<key_t> keys(other.adj_list.begin(), other.adj_list.end());
+        size_t shift = vertices_no;
+        check_vertices_no(vertices_no + other.vertices_no);
+        vertices_no += other.vertices_no;
+        edges_changed();
+        for (key_t k: keys) {
+            edge_t e = key::unpack(k);
+            adj_list.insert(adj_list.end(), key::pack({e.tail + shift, e.head + shift}));
+        }
+        points = Points();
+    }
 
-    // Interface methods
-    virtual void add_edge(const vertex_t a, const vertex_t b) = 0;
-    virtual std::string to_string() const = 0;
-    virtual void connect() = 0;
-    virtual void add_edges(const size_t edges_t) = 0;
+    /**
+     *  Replaces the graph with its cartesian product with other. The pair
+     *  made by vertex i of this graph and vertex j of other becomes vertex
+     *  j*N + i, where N is the number of vertices of this graph.
+     */
+    void cartesian_product_with(const Graph<label_t, weight_t, index_t, allocator_t>& other) {
+        // Adjacency rows of both graphs, in compressed form
+        auto rows = [](const Graph<label_t, weight_t, index_t, allocator_t>& g,
+                       std::vector<size_t>& start,
+                       std::vector<vertex_t>& heads) {
+            start.assign(g.vertices_no + 1, 0);
+            heads.clear();
+            for (key_t k: g.adj_list) {
+                edge_t e = key::unpack(k);
+                start[e.tail + 1]++;
+                heads.push_back(e.head);
+            }
+            std::partial_sum(start.begin(), start.end(), start.begin());
+        };
+        std::vector<size_t> start1, start2;
+        std::vector<vertex_t> heads1, heads2;
+        rows(*this, start1, heads1);
+        rows(other, start2, heads2);
 
-    void add_edge(const edge_t& v) {
-        add_edge(v.tail, v.head);
+        const size_t n1 = vertices_no, n2 = other.vertices_no;
+        check_vertices_no(n1 * n2);
+        edge_set_t res(adj_list.key_comp(), adj_list.get_allocator());
+        for (vertex_t j = 0; j < n2; j++) {
+            for (vertex_t i = 0; i < n1; i++) {
+                vertex_t tail = j*n1 + i;
+                // The neighbours (j', i) with j' < j come first, then the
+                // ones of the form (j, i'), then the remaining (j', i).
+                size_t k = start2[j];
+                for (; k < start2[j+1] && heads2[k] < j; k++)
+                    res.insert(res.end(), key::pack({tail, heads2[k]*n1 + i}));
+                for (size_t h = start1[i]; h < start1[i+1]; h++)
+                    res.insert(res.end(), key::pack({tail, j*n1 + heads1[h]}));
+                for (; k < start2[j+1]; k++)
+                    res.insert(res.end(), key::pack({tail, heads2[k]*n1 + i}));
+            }
+        }
+        adj_list.swap(res);
+        edges_changed();
+        vertices_no = n1 * n2;
+        points = Points();
     }
 
-    void build_forest(size_t edges_no) {
-        if (edges_no > vertices_no - 1)
-            throw TooManyEdgesException();
-        for(vertex_t v: RangeSampler(edges_no, 0, vertices_no-1))
-            add_edge(Random::randrange(0, v+1), v+1);
+    friend std::ostream& operator<<(
+        std::ostream& os,
+        const Graph<label_t, weight_t, index_t, allocator_t>& g
+    ) {
+        g.write(os);
+        return os;
     }
+};
 
-    void build_path() {
-        for(vertex_t i = 0; i < vertices_no - 1; i++)
-            add_edge(i, i+1);
+/**
+ *  HashSet is a set of 64-bit integers, implemented as an open addressing
+ *  hash table with linear probing. It is much faster than a btree_set or
+ *  an unordered_set for membership tests, and it needs a single
+ *  allocation. The value std::numeric_limits<uint64_t>::max() is reserved.
+ */
+class HashSet {
+private:
+    enum: uint64_t { EMPTY = std::numeric_limits<uint64_t>::max() };
+
+    std::vector<uint64_t> table;
+    size_t mask;
+    size_t elements;
+
+    size_t slot(const uint64_t key) const {
+        return utils::mix64(key) & mask;
     }
 
-    void build_cycle() {
-        for(vertex_t i = 0; i < vertices_no - 1; i++)
-            add_edge(i, i+1);
-        add_edge(vertices_no - 1, 0);
+    void grow() {
+        std::vector<uint64_t> old(2 * table.size(), EMPTY);
+        old.swap(table);
+        mask = table.size() - 1;
+        for (uint64_t key: old) {
+            if (key == EMPTY) continue;
+            size_t i = slot(key);
+            while (table[i] != EMPTY) i = (i + 1) & mask;
+            table[i] = key;
+        }
     }
 
-    void build_tree() {
-        build_forest(vertices_no - 1);
+public:
+    /**
+     *  @param expected the number of elements the set is expected to hold
+     */
+    HashSet(const size_t expected = 0): elements(0) {
+        size_t capacity = 16;
+        while (capacity < 2 * expected) capacity *= 2;
+        table.assign(capacity, EMPTY);
+        mask = capacity - 1;
     }
 
-    void build_star() {
-        for(vertex_t i=1; i<vertices_no; i++)
-            add_edge(0, i);
+    size_t size() const {
+        return elements;
     }
 
-    void build_wheel() {
-        for(vertex_t i=1; i<vertices_no; i++) {
-            add_edge(i-1, i);
-            add_edge(0, i);
-        }
-        add_edge(vertices_no, 0);
+    bool count(const uint64_t key) const {
+        for (size_t i = slot(key); table[i] != EMPTY; i = (i + 1) & mask)
+            if (table[i] == key) return true;
+        return false;
     }
 
-    void build_clique() {
-        for(vertex_t i=0; i<vertices_no; i++)
-            for(vertex_t j=i+1; j<vertices_no; j++)
-                add_edge(i, j);
+    bool insert(const uint64_t key) {
+        if (2 * (elements + 1) > table.size()) grow();
+        size_t i = slot(key);
+        for (; table[i] != EMPTY; i = (i + 1) & mask)
+            if (table[i] == key) return false;
+        table[i] = key;
+        elements++;
+        return true;
     }
- 
-    friend std::ostream& operator<<(
-        std::ostream& os,
-        const Graph<label_t, weight_t>& g
-    ) {
-        return os << g.to_string();
+
+    bool erase(const uint64_t key) {
+        size_t i = slot(key);
+        for (; table[i] != key; i = (i + 1) & mask)
+            if (table[i] == EMPTY) return false;
+        // Backward shift deletion: move back the elements that follow,
+        // so that no tombstones are needed.
+        for (size_t j = (i + 1) & mask; table[j] != EMPTY; j = (j + 1) & mask) {
+            size_t home = slot(table[j]);
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                table[i] = table[j];
+                i = j;
+            }
+        }
+        table[i] = EMPTY;
+        elements--;
+        return true;
     }
 };
 
@@ -468,159 +4808,599 @@ public:
 };
 
 
-template<typename label_t, typename weight_t = void>
-class UndirectedGraph: public Graph<label_t, weight_t> {
+template<
+    typename label_t,
+    typename weight_t = void,
+    typename index_t = uint32_t,
+    typename allocator_t = std::allocator<char>
+>
+class UndirectedGraph: public Graph<label_t, weight_t, index_t, allocator_t> {
 private:
-    using Graph<label_t, weight_t>::adj_list;
-    using Graph<label_t, weight_t>::labeler;
-    using Graph<label_t, weight_t>::weighter;
-    using Graph<label_t, weight_t>::add_random_edges;
-    using Graph<label_t, weight_t>::vertices_no;
-    using Graph<label_t, weight_t>::_to_string;
+    using typename Graph<label_t, weight_t, index_t, allocator_t>::key;
+    using typename Graph<label_t, weight_t, index_t, allocator_t>::key_t;
+    using Graph<label_t, weight_t, index_t, allocator_t>::adj_list;
+    using Graph<label_t, weight_t, index_t, allocator_t>::labeler;
+    using Graph<label_t, weight_t, index_t, allocator_t>::weighter;
+    using Graph<label_t, weight_t, index_t, allocator_t>::vertices_no;
+    using Graph<label_t, weight_t, index_t, allocator_t>::_write;
+    using Graph<label_t, weight_t, index_t, allocator_t>::_sample_edges;
+
+protected:
+    bool is_undirected() const override {
+        return true;
+    }
 
 public:
-    using Graph<label_t, weight_t>::Graph;
+    using Graph<label_t, weight_t, index_t, allocator_t>::Graph;
 
     ~UndirectedGraph() {};
 
+    UndirectedGraph operator~() const {
+        UndirectedGraph res(*this);
+        res.complement();
+        return res;
+    }
+
+    UndirectedGraph operator|(const UndirectedGraph& other) const {
+        UndirectedGraph res(*this);
+        res.union_with(other);
+        return res;
+    }
+
+    UndirectedGraph operator&(const UndirectedGraph& other) const {
+        UndirectedGraph res(*this);
+        res.intersect_with(other);
+        return res;
+    }
+
+    /**
+     *  Disjoint union of the two graphs
+     */
+    UndirectedGraph operator+(const UndirectedGraph& other) const {
+        UndirectedGraph res(*this);
+        res.disjoint_union_with(other);
+        return res;
+    }
+
+    /**
+     *  Cartesian product of the two graphs
+     */
+    UndirectedGraph operator*(const UndirectedGraph& other) const {
+        UndirectedGraph res(*this);
+        res.cartesian_product_with(other);
+        return res;
+    }
+
     void add_edge(const vertex_t tail, const vertex_t head) override {
-        adj_list.insert({tail, head});
-        adj_list.insert({head, tail});
+        this->check_edge({tail, head});
+        this->insert_key(key::pack({tail, head}));
+        this->insert_key(key::pack({head, tail}));
+    }
+
+    void add_edge_list(std::vector<edge_t> edges) override {
+        size_t edges_no = edges.size();
+        edges.reserve(2 * edges_no);
+        for (size_t i = 0; i < edges_no; i++)
+            edges.push_back({edges[i].head, edges[i].tail});
+        Graph<label_t, weight_t, index_t, allocator_t>::add_edge_list(std::move(edges));
+    }
+
+    void remove_edge(const vertex_t tail, const vertex_t head) override {
+        adj_list.erase(key::pack({tail, head}));
+        adj_list.erase(key::pack({head, tail}));
+        this->edges_changed();
+    }
+
+    void remove_edge_list(std::vector<edge_t> edges) override {
+        size_t edges_no = edges.size();
+        edges.reserve(2 * edges_no);
+        for (size_t i = 0; i < edges_no; i++)
+            edges.push_back({edges[i].head, edges[i].tail});
+        Graph<label_t, weight_t, index_t, allocator_t>::remove_edge_list(std::move(edges));
     }
 
-    std::string to_string() const override {
+    void sample_edges(const size_t edges_no) override {
         auto is_valid = [](const edge_t e) -> bool {
             return e.tail > e.head;
         };
 
-        return _to_string(is_valid);
+        _sample_edges(edges_no, is_valid);
     }
 
-    void connect() override {
-        DisjointSet connected_components(vertices_no);
-        for (edge_t e: adj_list)
-            connected_components.merge(e.tail, e.head);
+    void write(std::ostream& os) const override {
+        auto is_valid = [](const edge_t e) -> bool {
+            return e.tail > e.head;
+        };
+
+        _write(os, is_valid);
+    }
+
+    /**
+     *  Writes the graph with edges_no more random edges, using temporary
+     *  files so that at most about memory_budget bytes are used for them.
+     *  The new edges are not added to the graph.
+     */
+    void write_with_random_edges(
+        std::ostream& os,
+        const size_t edges_no,
+        const size_t memory_budget = size_t(1) << 30
+    ) const {
+        this->template _write_with_random_edges<TriangularRanking>(
+            os, edges_no, memory_budget
+        );
+    }
 
-        // We are going to scan through the vertices in random order
-        std::vector<size_t> vertices(vertices_no);
-        std::iota(vertices.begin(), vertices.end(), 0);
-        std::random_shuffle(vertices.begin(), vertices.end());
+    /**
+     *  Connects the graph with a random tree over one random vertex of
+     *  each connected component. The components are those kept by the
+     *  graph (see track_components), so with tracking enabled this takes
+     *  time proportional to their number.
+     */
+    void connect() override {
+        GRAPHGEN_PHASE(CONNECT);
+        ComponentSet& components = this->get_components();
 
-        // repr contains K representative vertices, with K the
-        // number of connected components in the graph. A representative is a
+        // repr contains K representative vertices, with K the number of
+        // connected components, in random order. A representative is a
         // randomly chosen vertex among the vertices forming its connected
         // component
-        std::vector<vertex_t> repr = { vertices[0] };
-        for(size_t i = 1; i < vertices_no; i++) {
-            if (connected_components.merge(vertices[0], vertices[i])) {
-                repr.push_back(vertices[i]);
-            }
-        }
+        std::vector<vertex_t> repr;
+        repr.reserve(components.count());
+        for (size_t root: components.get_roots())
+            repr.push_back(components.random_member(root));
+        Random::shuffle(repr.begin(), repr.end());
+        if (repr.size() < 2) return;
 
-        // Build a random tree spanning the representative vertices
+        // Build a random tree spanning the representative vertices, where
+        // the parent of repr[i] is among the previous ones
+        std::vector<size_t> parent(repr.size() - 1);
+        std::iota(parent.begin(), parent.end(), 1);
+        Random::fill_below(parent.data(), parent.data(), parent.size());
+        std::vector<edge_t> edges(parent.size());
         for (size_t i = 1; i < repr.size(); i++)
-            add_edge(repr[Random::randrange(0, i)], repr[i]);
+            edges[i-1] = {repr[parent[i-1]], repr[i]};
+        this->add_edge_list(std::move(edges));
     }
 
     void add_edges(const size_t edges_no) {
-        auto is_valid = [](const edge_t e) -> bool {
-            return e.tail > e.head;
-        };
+        this->template add_random_edges<TriangularRanking>(edges_no);
+    }
+
+    /**
+     *  Replaces the edges of the graph with a uniformly random spanning
+     *  tree of it, or a spanning forest with a uniformly random tree for
+     *  each connected component.
+     *
+     *  This is Wilson's algorithm: starting from a random root in each
+     *  component, a random walk from every vertex not yet in the tree is
+     *  followed until it hits the tree, and its loop-erased path is added.
+     *  The loops are erased implicitly, since only the last exit from each
+     *  vertex is remembered. The walks run on a CSR snapshot of the edges,
+     *  with no recursion.
+     */
+    void random_spanning_tree() {
+        const size_t n = vertices_no;
+        // The neighbours of v are heads[offsets[v]] ... heads[offsets[v+1] - 1]
+        std::vector<size_t> offsets(n + 1, 0);
+        std::vector<index_t> heads;
+        heads.reserve(adj_list.size());
+        for (key_t k: adj_list) {
+            edge_t e = key::unpack(k);
+            if (e.tail == e.head) continue;
+            offsets[e.tail + 1]++;
+            heads.push_back(e.head);
+        }
+        for (size_t v = 0; v < n; v++)
+            offsets[v + 1] += offsets[v];
+
+        // A random root for each connected component, found with a BFS
+        std::vector<uint8_t> in_tree(n, 0);
+        std::vector<index_t> next(n);
+        {
+            std::vector<uint8_t> seen(n, 0);
+            std::vector<index_t> order;
+            order.reserve(n);
+            for (size_t s = 0; s < n; s++) {
+                if (seen[s]) continue;
+                size_t start = order.size();
+                seen[s] = 1;
+                order.push_back(s);
+                for (size_t i = start; i < order.size(); i++)
+                    for (size_t j = offsets[order[i]]; j < offsets[order[i] + 1]; j++)
+                        if (!seen[heads[j]]) {
+                            seen[heads[j]] = 1;
+                            order.push_back(heads[j]);
+                        }
+                in_tree[order[Random::randrange(start, order.size())]] = 1;
+            }
+        }
+
+        std::vector<edge_t> edges;
+        edges.reserve(n);
+        for (size_t v = 0; v < n; v++) {
+            size_t u = v;
+            while (!in_tree[u]) {
+                next[u] = heads[Random::randrange(offsets[u], offsets[u+1])];
+                u = next[u];
+            }
+            for (u = v; !in_tree[u]; u = next[u]) {
+                in_tree[u] = 1;
+                edges.push_back({u, next[u]});
+            }
+        }
+
+        adj_list.clear();
+        this->edges_changed();
+        add_edge_list(std::move(edges));
+    }
+
+    /**
+     *  Creates a random regular graph with the given degree.
+     *
+     *  The edges are first generated with the pairing model, and then the
+     *  self loops and multiple edges it produces are removed by swapping
+     *  them with random good edges. Finally, if switches is not zero, that
+     *  many degree-preserving edge switches are attempted to better mix the
+     *  graph. The switches are drawn and applied sequentially, in batches
+     *  of switches on disjoint vertices; only the lookups that check
+     *  whether the switches of a batch would create multiple edges are
+     *  done in parallel.
+     *
+     *  @param degree    the degree of every vertex
+     *  @param switches  the number of edge switches to attempt
+     */
+    void build_regular(const size_t degree, const size_t switches = 0) {
+        if (degree >= vertices_no || vertices_no * degree % 2 != 0)
+            throw TooManyEdgesException();
+        if (degree == vertices_no - 1) {
+            this->build_clique();
+            return;
+        }
 
-        auto edge_to_rank = [](edge_t e) -> uint64_t {
-            return (uint64_t)e.tail*(e.tail+1)/2 + e.head;
+        const uint64_t n = vertices_no;
+        auto key = [n](vertex_t a, vertex_t b) -> uint64_t {
+            return a < b ? a * n + b : b * n + a;
         };
 
-        auto rank_to_edge = [](uint64_t rank) -> edge_t {
-            edge_t e;
-            e.tail = round(sqrt(2*(rank+1)));
-            e.head = rank - e.tail*(e.tail-1)/2;
-            return e;
+        std::vector<edge_t> edges;
+        HashSet edge_set;
+        bool done = false;
+        while (!done) {
+            std::vector<vertex_t> stubs(vertices_no * degree);
+            for (size_t i = 0; i < stubs.size(); i++)
+                stubs[i] = i / degree;
+            Random::shuffle(stubs.begin(), stubs.end());
+
+            edges.clear();
+            edge_set = HashSet(stubs.size() / 2);
+            std::vector<edge_t> bad;
+            for (size_t i = 0; i < stubs.size(); i += 2) {
+                vertex_t a = stubs[i], b = stubs[i+1];
+                if (a != b && edge_set.insert(key(a, b)))
+                    edges.push_back({a, b});
+                else
+                    bad.push_back({a, b});
+            }
+            // Without good edges the bad pairs cannot be fixed
+            if (edges.empty() && !bad.empty())
+                continue;
+
+            // Each bad pair {a, b} is fixed by picking a random good edge
+            // {c, d} and replacing both with {a, c} and {b, d}. If this
+            // takes too long, we just start again from scratch.
+            size_t attempts = 0, max_attempts = 100 * (bad.size() + 1);
+            done = true;
+            for (edge_t e: bad) {
+                while (true) {
+                    if (attempts++ > max_attempts) {
+                        done = false;
+                        break;
+                    }
+                    size_t k = Random::randrange(0, edges.size());
+                    vertex_t c = edges[k].tail, d = edges[k].head;
+                    if (Random::randrange(0, 2)) std::swap(c, d);
+                    if (e.tail == c || e.head == d || key(e.tail, c) == key(e.head, d) ||
+                        edge_set.count(key(e.tail, c)) || edge_set.count(key(e.head, d)))
+                        continue;
+                    edge_set.erase(key(c, d));
+                    edge_set.insert(key(e.tail, c));
+                    edge_set.insert(key(e.head, d));
+                    edges[k] = {e.tail, c};
+                    edges.push_back({e.head, d});
+                    break;
+                }
+                if (!done) break;
+            }
+        }
+
+        // Degree 0: there are no edges to add nor to switch
+        if (edges.empty())
+            return;
+
+        // Edge switches: {a, b}, {c, d} -> {a, d}, {c, b}. The proposals of a
+        // batch touching a vertex already used in it are drawn again, so that
+        // the batch is independent and can be checked in parallel. They are
+        // not counted as attempts, and batches use at most a quarter of the
+        // vertices, so that such conflicts stay rare.
+        struct proposal_t {
+            size_t i, j;
+            vertex_t a, b, c, d;
+            bool ok;
         };
-        add_random_edges(
-            edges_no,
-            vertices_no*(vertices_no-1)/2,
-            is_valid,
-            edge_to_rank,
-            rank_to_edge
-        );
+        std::vector<size_t> used(vertices_no, 0);
+        size_t batch_size = std::max<size_t>(1, vertices_no / 16);
+        size_t batch_no = 0;
+        for (size_t done_switches = 0; done_switches < switches; ) {
+            batch_no++;
+            size_t len = std::min(batch_size, switches - done_switches);
+            done_switches += len;
+            std::vector<proposal_t> batch;
+            for (size_t t = 0; t < len; ) {
+                proposal_t p;
+                p.i = Random::randrange(0, edges.size());
+                p.j = Random::randrange(0, edges.size());
+                p.a = edges[p.i].tail;
+                p.b = edges[p.i].head;
+                p.c = edges[p.j].tail;
+                p.d = edges[p.j].head;
+                if (Random::randrange(0, 2)) std::swap(p.c, p.d);
+                if (used[p.a] == batch_no || used[p.b] == batch_no ||
+                    used[p.c] == batch_no || used[p.d] == batch_no)
+                    continue;
+                // A switch between adjacent edges is attempted, and fails
+                t++;
+                if (p.a == p.c || p.a == p.d || p.b == p.c || p.b == p.d)
+                    continue;
+                used[p.a] = used[p.b] = used[p.c] = used[p.d] = batch_no;
+                batch.push_back(p);
+            }
+            utils::parallel_for(batch.size(), [&](size_t begin, size_t end) {
+                for (size_t t = begin; t < end; t++) {
+                    proposal_t& p = batch[t];
+                    p.ok = !edge_set.count(key(p.a, p.d)) &&
+                           !edge_set.count(key(p.c, p.b));
+                }
+            }, 1 << 12);
+            for (proposal_t& p: batch) {
+                if (!p.ok) continue;
+                edge_set.erase(key(p.a, p.b));
+                edge_set.erase(key(p.c, p.d));
+                edge_set.insert(key(p.a, p.d));
+                edge_set.insert(key(p.c, p.b));
+                edges[p.i] = {p.a, p.d};
+                edges[p.j] = {p.c, p.b};
+            }
+        }
+
+        add_edge_list(std::move(edges));
     }
 };
 
-template<typename label_t, typename weight_t = void>
-class DirectedGraph: public Graph<label_t, weight_t> {
+template<
+    typename label_t,
+    typename weight_t = void,
+    typename index_t = uint32_t,
+    typename allocator_t = std::allocator<char>
+>
+class DirectedGraph: public Graph<label_t, weight_t, index_t, allocator_t> {
 private:
-    using Graph<label_t, weight_t>::adj_list;
-    using Graph<label_t, weight_t>::labeler;
-    using Graph<label_t, weight_t>::weighter;
-    using Graph<label_t, weight_t>::add_random_edges;
-    using Graph<label_t, weight_t>::vertices_no;
-    using Graph<label_t, weight_t>::_to_string;
+    using typename Graph<label_t, weight_t, index_t, allocator_t>::key;
+    using typename Graph<label_t, weight_t, index_t, allocator_t>::key_t;
+    using Graph<label_t, weight_t, index_t, allocator_t>::adj_list;
+    using Graph<label_t, weight_t, index_t, allocator_t>::labeler;
+    using Graph<label_t, weight_t, index_t, allocator_t>::weighter;
+    using Graph<label_t, weight_t, index_t, allocator_t>::vertices_no;
+    using Graph<label_t, weight_t, index_t, allocator_t>::_write;
+    using Graph<label_t, weight_t, index_t, allocator_t>::_sample_edges;
 
 public:
-    using Graph<label_t, weight_t>::Graph;
+    using Graph<label_t, weight_t, index_t, allocator_t>::Graph;
 
     ~DirectedGraph() {};
 
+    DirectedGraph operator~() const {
+        DirectedGraph res(*this);
+        res.complement();
+        return res;
+    }
+
+    DirectedGraph operator|(const DirectedGraph& other) const {
+        DirectedGraph res(*this);
+        res.union_with(other);
+        return res;
+    }
+
+    DirectedGraph operator&(const DirectedGraph& other) const {
+        DirectedGraph res(*this);
+        res.intersect_with(other);
+        return res;
+    }
+
+    /**
+     *  Disjoint union of the two graphs
+     */
+    DirectedGraph operator+(const DirectedGraph& other) const {
+        DirectedGraph res(*this);
+        res.disjoint_union_with(other);
+        return res;
+    }
+
+    /**
+     *  Cartesian product of the two graphs
+     */
+    DirectedGraph operator*(const DirectedGraph& other) const {
+        DirectedGraph res(*this);
+        res.cartesian_product_with(other);
+        return res;
+    }
+
     void add_edge(const vertex_t tail, const vertex_t head) override {
-        adj_list.insert({tail, head});
+        this->check_edge({tail, head});
+        this->insert_key(key::pack({tail, head}));
+    }
+
+    void remove_edge(const vertex_t tail, const vertex_t head) override {
+        adj_list.erase(key::pack({tail, head}));
+        this->edges_changed();
     }
 
-    std::string to_string() const override {
+    void sample_edges(const size_t edges_no) override {
         auto is_valid = [](const edge_t e) -> bool {
             return e.tail != e.head;
         };
 
-        return _to_string(is_valid);
+        _sample_edges(edges_no, is_valid);
     }
 
-    void add_edges(const size_t edges_no) {
+    void write(std::ostream& os) const override {
         auto is_valid = [](const edge_t e) -> bool {
             return e.tail != e.head;
         };
 
-        auto edge_to_rank = [&](edge_t e) -> uint64_t {
-            return (uint64_t)e.tail*(vertices_no-1) + e.head - (e.head>e.tail);
-        };
+        _write(os, is_valid);
+    }
 
-        auto rank_to_edge = [&](uint64_t rank) -> edge_t {
-            edge_t e;
-            e.tail = rank / (vertices_no-1);
-            e.head = rank - e.tail*(vertices_no-1);
-            if (e.head >= e.tail) e.head++;
-            return e;
-        };
-        add_random_edges(
-            edges_no,
-            vertices_no*(vertices_no-1),
-            is_valid,
-            edge_to_rank,
-            rank_to_edge
+    /**
+     *  Writes the graph with edges_no more random edges, using temporary
+     *  files so that at most about memory_budget bytes are used for them.
+     *  The new edges are not added to the graph.
+     */
+    void write_with_random_edges(
+        std::ostream& os,
+        const size_t edges_no,
+        const size_t memory_budget = size_t(1) << 30
+    ) const {
+        this->template _write_with_random_edges<SquareRanking>(
+            os, edges_no, memory_budget
         );
     }
 
+    void add_edges(const size_t edges_no) {
+        this->template add_random_edges<SquareRanking>(edges_no);
+    }
+
     void build_dag(const size_t edges_no) {
-        auto is_valid = [](const edge_t e) -> bool {
-            return e.tail > e.head;
-        };
+        this->template add_random_edges<TriangularRanking>(edges_no);
+    }
 
-        auto edge_to_rank = [](edge_t e) -> uint64_t {
-            return (uint64_t)e.tail*(e.tail+1)/2 + e.head;
-        };
+    /**
+     *  Creates a random DAG whose vertices are split in layers of the given
+     *  widths, with edges_no edges that all go from a layer to one of the
+     *  next span layers (any later layer if span is 0). A path crossing all
+     *  the layers is always added, so the longest path has exactly
+     *  widths.size() - 1 edges; the other edges are chosen uniformly among
+     *  the allowed ones. The vertices are assigned to the layers by a
+     *  random permutation, so their indices do not reveal the order.
+     *
+     *  With the vertices sorted by layer, the heads allowed for a tail in
+     *  layer i are a contiguous range, of the same size for the whole
+     *  layer. The allowed edges are then ranked layer by layer, and the
+     *  samples are converted to edges in parallel.
+     */
+    void build_layered_dag(
+        const std::vector<size_t>& widths,
+        const size_t edges_no,
+        const size_t span = 1
+    ) {
+        const size_t layers_no = widths.size();
+        if (layers_no == 0 || std::accumulate(widths.begin(), widths.end(), size_t(0)) < vertices_no)
+            throw TooFewNodesException();
+        if (std::accumulate(widths.begin(), widths.end(), size_t(0)) > vertices_no)
+            throw TooManyNodesException();
+        if (std::count(widths.begin(), widths.end(), size_t(0)) > 0)
+            throw TooFewNodesException();
+        if (edges_no < layers_no - 1)
+            throw TooFewEdgesException();
 
-        auto rank_to_edge = [](uint64_t rank) -> edge_t {
-            edge_t e;
-            e.tail = round(sqrt(2*(rank+1)));
-            e.head = rank - e.tail*(e.tail-1)/2;
-            return e;
-        };
-        add_random_edges(
-            edges_no,
-            vertices_no*(vertices_no-1)/2,
-            is_valid,
-            edge_to_rank,
-            rank_to_edge
-        );
+        // Layer i holds the positions [begin[i], begin[i+1]); its tails
+        // can reach the heads [begin[i+1], begin[reach[i]]), and its edges
+        // have the ranks [offset[i], offset[i+1]).
+        std::vector<uint64_t> begin(layers_no + 1, 0), offset(layers_no + 1, 0);
+        std::vector<size_t> reach(layers_no);
+        for (size_t i = 0; i < layers_no; i++)
+            begin[i+1] = begin[i] + widths[i];
+        for (size_t i = 0; i < layers_no; i++) {
+            reach[i] = span == 0 ? layers_no : std::min(layers_no, i + 1 + span);
+            offset[i+1] = offset[i] + widths[i] * (begin[reach[i]] - begin[i+1]);
+        }
+        if (offset[layers_no] < edges_no ||
+            offset[layers_no] > uint64_t(std::numeric_limits<int64_t>::max()))
+            throw TooManyEdgesException();
+
+        // The path through the layers, one random vertex for each of them
+        std::vector<uint64_t> path(layers_no), path_ranks(layers_no - 1);
+        for (size_t i = 0; i < layers_no; i++)
+            path[i] = Random::randrange(begin[i], begin[i+1]);
+        for (size_t i = 0; i + 1 < layers_no; i++)
+            path_ranks[i] = offset[i] + (path[i] - begin[i]) * (begin[reach[i]] - begin[i+1]) +
+                            (path[i+1] - begin[i+1]);
+
+        std::vector<vertex_t> vertex(vertices_no);
+        std::iota(vertex.begin(), vertex.end(), 0);
+        Random::shuffle(vertex.begin(), vertex.end());
+
+        std::vector<key_t> keys(edges_no);
+        for (size_t i = 0; i + 1 < layers_no; i++)
+            keys[i] = key::pack({vertex[path[i]], vertex[path[i+1]]});
+        {
+            utils::ScratchScope scope;
+            RangeSampler sampler(
+                edges_no - (layers_no - 1), 0, offset[layers_no],
+                std::vector<int64_t>(path_ranks.begin(), path_ranks.end()),
+                RangeSampler::allocator_type(&utils::scratch_arena())
+            );
+            RangeSampler::iterator ranks = sampler.begin();
+            key_t* out = keys.data() + layers_no - 1;
+            utils::parallel_for(edges_no - (layers_no - 1), [&](size_t from, size_t to) {
+                size_t i = std::upper_bound(offset.begin(), offset.end(), uint64_t(ranks[from])) -
+                           offset.begin() - 1;
+                for (size_t j = from; j < to; j++) {
+                    // The ranks are sorted, so the layers only move forward
+                    while (uint64_t(ranks[j]) >= offset[i+1]) i++;
+                    uint64_t r = ranks[j] - offset[i];
+                    uint64_t heads = begin[reach[i]] - begin[i+1];
+                    out[j] = key::pack({
+                        vertex[begin[i] + r / heads],
+                        vertex[begin[i+1] + r % heads]
+                    });
+                }
+            });
+        }
+        this->insert_keys(keys);
+    }
+
+    /**
+     *  Same as above, with the given number of layers. Their widths are
+     *  as equal as possible, or a uniformly random composition of the
+     *  vertices if random_widths is true. For a DAG whose longest path has
+     *  d edges, use d + 1 layers.
+     */
+    void build_layered_dag(
+        const size_t layers_no,
+        const size_t edges_no,
+        const size_t span = 1,
+        const bool random_widths = false
+    ) {
+        if (layers_no == 0)
+            throw TooFewNodesException();
+        if (layers_no > vertices_no)
+            throw TooManyNodesException();
+        std::vector<size_t> widths(layers_no);
+        if (random_widths) {
+            // The layers end at layers_no - 1 random cut points
+            size_t last = 0;
+            RangeSampler cuts(layers_no - 1, 1, vertices_no);
+            auto cut = cuts.begin();
+            for (size_t i = 0; i + 1 < layers_no; i++, ++cut) {
+                widths[i] = *cut - last;
+                last = *cut;
+            }
+            widths[layers_no - 1] = vertices_no - last;
+        } else {
+            for (size_t i = 0; i < layers_no; i++)
+                widths[i] = vertices_no * (i+1) / layers_no - vertices_no * i / layers_no;
+        }
+        build_layered_dag(widths, edges_no, span);
     }
 
     /**
@@ -632,3 +5412,195 @@ public:
         throw NotImplementedException();
     }
 };
+
+#ifdef GRAPHGEN_USE_ZLIB
+/**
+ *  GzipStreambuf is a stream buffer that compresses everything written to
+ *  it in gzip format, and writes the result to another stream. Use it as
+ *
+ *      std::ofstream file("graph.txt.gz", std::ios::binary);
+ *      GzipStreambuf buf(file);
+ *      std::ostream os(&buf);
+ *      os << graph;
+ *      buf.close();
+ *
+ *  Like pigz, the data is split in blocks that are compressed independently
+ *  by different threads, and then concatenated in a single gzip stream.
+ *  Each block is primed with the last 32KB of the previous one, so that the
+ *  compression ratio is almost the same as a sequential gzip.
+ *  Compression needs zlib, so this is only available if GRAPHGEN_USE_ZLIB
+ *  is defined.
+ */
+class GzipStreambuf: public std::streambuf {
+private:
+    struct compressed_t {
+        std::string data;
+        uLong crc;
+        size_t length;
+    };
+
+    std::ostream& sink;
+    int level;
+    std::vector<char> buffer;
+    std::string dictionary;
+    std::deque<std::future<compressed_t>> pending;
+    uLong crc;
+    uint64_t total_in;
+    bool closed;
+    // Set while a block is dispatched, so it stays set if that fails
+    bool failed;
+
+    static compressed_t compress(
+        const std::string& input,
+        const std::string& dictionary,
+        const int level,
+        const bool last
+    ) {
+        compressed_t res;
+        res.crc = crc32(crc32(0, Z_NULL, 0), (const Bytef*) input.data(), input.size());
+        res.length = input.size();
+
+        z_stream strm;
+        strm.zalloc = Z_NULL;
+        strm.zfree = Z_NULL;
+        strm.opaque = Z_NULL;
+        if (deflateInit2(&strm, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw CompressionException();
+        if (!dictionary.empty() &&
+            deflateSetDictionary(&strm, (const Bytef*) dictionary.data(),
+                                 dictionary.size()) != Z_OK) {
+            deflateEnd(&strm);
+            throw CompressionException();
+        }
+        res.data.resize(deflateBound(&strm, input.size()) + 16);
+        strm.next_in = (Bytef*) input.data();
+        strm.avail_in = input.size();
+        strm.next_out = (Bytef*) &res.data[0];
+        strm.avail_out = res.data.size();
+        // All the blocks but the last one end with a sync flush, so that
+        // they can simply be concatenated.
+        int ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+        if ((last && ret != Z_STREAM_END) || (!last && ret != Z_OK)) {
+            deflateEnd(&strm);
+            throw CompressionException();
+        }
+        res.data.resize(res.data.size() - strm.avail_out);
+        deflateEnd(&strm);
+        return res;
+    }
+
+    void write_compressed(const compressed_t& block) {
+        sink.write(block.data.data(), block.data.size());
+        crc = crc32_combine(crc, block.crc, block.length);
+        total_in += block.length;
+    }
+
+    void write_le32(uint32_t v) {
+        char bytes[4];
+        for (int i = 0; i < 4; i++)
+            bytes[i] = (v >> (8*i)) & 0xff;
+        sink.write(bytes, 4);
+    }
+
+    /**
+     *  Hands the current content of the buffer to a compression thread.
+     */
+    void dispatch(const bool last) {
+        failed = true;
+        const size_t window = 32768;
+        std::string input(pbase(), pptr());
+        std::string dict = dictionary;
+        if (input.size() < window)
+            dictionary += input;
+        else
+            dictionary.assign(input.end() - window, input.end());
+        if (dictionary.size() > window)
+            dictionary.erase(0, dictionary.size() - window);
+        pending.push_back(std::async(
+            std::launch::async, compress, std::move(input), std::move(dict), level, last
+        ));
+        setp(buffer.data(), buffer.data() + buffer.size());
+        // Keep at most one block per thread in flight
+        while (pending.size() > utils::threads_no() || (last && !pending.empty())) {
+            write_compressed(pending.front().get());
+            pending.pop_front();
+        }
+        failed = false;
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (closed) return traits_type::eof();
+        dispatch(false);
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    /**
+     *  Compresses the buffered data as a block of its own, waits for all
+     *  the blocks in flight and flushes the sink, so that everything
+     *  written so far can be decompressed from it.
+     */
+    int sync() override {
+        if (!closed && !failed && pptr() > pbase()) {
+            dispatch(false);
+            failed = true;
+            while (!pending.empty()) {
+                write_compressed(pending.front().get());
+                pending.pop_front();
+            }
+            failed = false;
+        }
+        sink.flush();
+        return sink && !failed ? 0 : -1;
+    }
+
+public:
+    /**
+     *  @param sink        where the compressed data is written
+     *  @param level       the zlib compression level, from 1 to 9
+     *  @param block_size  the size of the blocks compressed by each thread
+     */
+    GzipStreambuf(
+        std::ostream& sink,
+        const int level = Z_DEFAULT_COMPRESSION,
+        const size_t block_size = 1 << 20
+    ): sink(sink), level(level), buffer(block_size),
+       crc(crc32(0, Z_NULL, 0)), total_in(0), closed(false), failed(false) {
+        setp(buffer.data(), buffer.data() + buffer.size());
+        const char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3};
+        sink.write(header, sizeof(header));
+    }
+
+    /**
+     *  Closes the stream, unless writing it failed or an exception is in
+     *  flight: then the trailer is left out, so that the truncated output
+     *  is not mistaken for a valid gzip stream.
+     */
+    ~GzipStreambuf() {
+        if (failed || !sink || std::uncaught_exception()) return;
+        try {
+            close();
+        } catch (...) {}
+    }
+
+    /**
+     *  Compresses the remaining data and writes the gzip trailer. Nothing
+     *  can be written after this. Throws IOException if writing to the
+     *  sink or compressing a block failed, without writing the trailer.
+     */
+    void close() {
+        if (closed) return;
+        if (failed || !sink)
+            throw IOException();
+        closed = true;
+        dispatch(true);
+        write_le32(crc);
+        write_le32(total_in & 0xffffffff);
+        sink.flush();
+    }
+};
+#endif
@@ -23,7 +23,15 @@ from distutils.core import setup, Extension
 
 
 module = Extension('graphgen', sources = ['graphgen.cpp'])
-module.extra_compile_args = ['--std=c++11', '-Wall', '-pedantic', '-g'];
+module.extra_compile_args = ['--std=c++11', '-Wall', '-pedantic', '-g', '-pthread'];
+module.extra_link_args = ['-pthread'];
+module.define_macros = [('GRAPHGEN_USE_ZLIB', None)];
+module.libraries = ['z'];
+
+# Build with GRAPHGEN_STATS=1 to enable the timers and counters returned by
+# graphgen.stats()
+if os.environ.get('GRAPHGEN_STATS'):
+    module.define_macros.append(('GRAPHGEN_STATS', None))
 
 headers_path = os.path.join("include", "graphgen")
 
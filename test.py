@@ -28,3 +28,197 @@ print g
 g = graphgen.DirectedGraph(5)
 g.add_edges(20)
 print g
+
+# testing geometric graphs
+g = graphgen.UndirectedGraph(20)
+g.build_geometric(0.3)
+print g
+
+# testing regular graphs
+g = graphgen.UndirectedGraph(10)
+g.build_regular(3, 100)
+print g
+
+# testing graph algebra
+a = graphgen.UndirectedGraph(4)
+a.build_path()
+b = graphgen.UndirectedGraph(2)
+b.build_path()
+print ~a
+print a | ~a
+print a & ~a
+print a + b
+print a * b
+
+# testing edge removal and subgraphs
+g = graphgen.UndirectedGraph(6)
+g.build_clique()
+g.remove_edge(0, 1)
+g.remove_edges([(2, 3), (4, 5)])
+g.sample_edges(8)
+g.induced_subgraph([5, 4, 3, 2])
+print g
+
+# testing background generation
+g = graphgen.UndirectedGraph(100)
+g.build_tree()
+futures = [g.add_edges_async(10) for i in range(5)]
+futures[-1].result()
+print all(f.done() for f in futures)
+print g
+
+# testing statistics
+graphgen.reset_stats()
+g = graphgen.UndirectedGraph(50)
+g.build_tree()
+str(g)
+print sorted(graphgen.stats().keys())
+
+# testing verification
+g = graphgen.UndirectedGraph(100)
+g.build_tree()
+g.verify("simple,connected,tree", 99)
+g.add_edges(1)
+try:
+    g.verify("tree")
+    print "not detected"
+except ValueError as e:
+    print e
+d = graphgen.DirectedGraph(100)
+d.build_dag(500)
+d.verify("simple acyclic", 500)
+
+# testing loading
+g = graphgen.DirectedGraph(30)
+g.build_dag(60)
+g.write("/tmp/graphgen_test_load.txt")
+h = graphgen.DirectedGraph(0)
+h.load("/tmp/graphgen_test_load.txt")
+h.verify("simple,acyclic", 60)
+h.add_edges(5)
+print h
+
+# testing the export of arrays
+import struct
+g = graphgen.UndirectedGraph(5)
+g.build_star()
+e = memoryview(g.edges())
+print e.format, e.itemsize, e.shape, e.readonly
+print struct.unpack("8I", e.tobytes())
+d = graphgen.DirectedGraph(4)
+d.build_path()
+print struct.unpack("4I", memoryview(d.in_degrees()).tobytes())
+print struct.unpack("5I", memoryview(g.degrees()).tobytes())
+try:
+    g.weights()
+except ValueError as ex:
+    print ex
+
+# testing layered dags
+g = graphgen.DirectedGraph(40)
+g.build_layered_dag(5, 100)
+g.verify("simple,acyclic", 100)
+g = graphgen.DirectedGraph(40)
+g.build_layered_dag(8, 200, 0, True)
+g.verify("simple,acyclic", 200)
+print g
+
+# testing random spanning trees
+g = graphgen.UndirectedGraph(20)
+g.build_grid(4, 5)
+g.random_spanning_tree()
+g.verify("tree")
+print g
+
+# testing connected components
+g = graphgen.UndirectedGraph(10)
+g.track_components()
+g.add_edge_list([(0, 1), (1, 2), (5, 6)])
+g.add_edge(7, 8)
+print g.component_count(), g.same_component(0, 2), g.same_component(0, 5)
+g.remove_edge(1, 2)
+print g.component_count()
+g.connect()
+print g.component_count()
+g.verify("connected")
+
+# testing fingerprints
+g = graphgen.UndirectedGraph(5)
+g.add_edge_list([(0, 1), (0, 2), (0, 3), (0, 4)])
+h = graphgen.UndirectedGraph(5)
+h.add_edge_list([(4, 0), (3, 0), (2, 0), (1, 0)])
+print g.fingerprint() == h.fingerprint()
+h = graphgen.UndirectedGraph(5)
+h.add_edge_list([(3, 0), (3, 1), (3, 2), (3, 4)])
+print g.fingerprint() == h.fingerprint(), g.fingerprint(1) == h.fingerprint(1)
+
+# testing update streams
+g = graphgen.UndirectedGraph(10)
+g.build_tree()
+g.write_updates("/tmp/graphgen_updates.txt", "/tmp/graphgen_answers.txt", 20, 1, 1, 2)
+lines = open("/tmp/graphgen_updates.txt").read().split("\n")
+print lines[10], len(lines[11:-1]), all(l[0] in "+-?" for l in lines[11:-1])
+answers = open("/tmp/graphgen_answers.txt").read().split()
+print len(answers) == sum(l[0] == "?" for l in lines[11:-1]), set(answers) <= set(["0", "1"])
+
+# testing euclidean weights
+g = graphgen.UndirectedGraph(15)
+g.build_grid(3, 5)
+g.assign_euclidean_weights(8)
+w = memoryview(g.weights())
+print w.format, len(w.tobytes()) / w.itemsize, set(struct.unpack("22d", w.tobytes()))
+g = graphgen.UndirectedGraph(15)
+g.build_path()
+try:
+    g.assign_euclidean_weights()
+except ValueError as ex:
+    print ex
+
+# testing random weights
+g = graphgen.UndirectedGraph(100)
+g.add_edges(300)
+g.assign_random_weights(5, 10)
+w = memoryview(g.weights())
+print w.format, w.shape, set(struct.unpack("300q", w.tobytes())) == set(range(5, 10))
+g.assign_random_weights(0.5, 1.0)
+w = struct.unpack("300d", memoryview(g.weights()).tobytes())
+print memoryview(g.weights()).format, all(0.5 <= x < 1.0 for x in w)
+g.add_edge(0, 0)
+try:
+    g.weights()
+except ValueError as ex:
+    print ex
+
+# testing compressed output
+import gzip
+g = graphgen.UndirectedGraph(100000)
+g.add_edges(200000)
+graphgen.srand(7)
+g.write("/tmp/graphgen_gzip.txt")
+graphgen.srand(7)
+g.write("/tmp/graphgen_gzip.txt.gz")
+text = open("/tmp/graphgen_gzip.txt", "rb").read()
+print len(text) > 2 * 2**20, gzip.open("/tmp/graphgen_gzip.txt.gz", "rb").read() == text
+
+# testing writing with random edges through temporary files
+for Graph in [graphgen.UndirectedGraph, graphgen.DirectedGraph]:
+    g = Graph(2000)
+    g.add_edges(1000)
+    g.write_with_random_edges("/tmp/graphgen_extra.txt", 300000, 1 << 16)
+    h = Graph(1)
+    h.load("/tmp/graphgen_extra.txt")
+    h.verify("simple", 301000)
+    print len(memoryview(h.degrees()).tobytes()) / 4, len(memoryview(h.edges()).tobytes()) / 8
+
+# testing edges out of range
+g = graphgen.DirectedGraph(10)
+for edges in [[(-1, 2)], [(3, 10)]]:
+    try:
+        g.add_edge_list(edges)
+    except ValueError as ex:
+        print ex,
+try:
+    graphgen.UndirectedGraph(10).add_edge(2, -1)
+except ValueError as ex:
+    print ex
+print len(memoryview(g.edges()).tobytes())
@@ -0,0 +1,61 @@
+// Checks the properties of a graph file written by the library, in the
+// "N M / tail head [weight]" format.
+//
+// Usage: verify [--directed] [--base B] <file> [properties]
+//
+// The properties are a comma separated list of simple, connected, acyclic
+// and tree (see verifier in graphgen.hpp). The endpoints are always checked
+// to be among the N vertices, whose labels go from B (default 0) to
+// B + N - 1, and the number of edges is always checked against M.
+//
+// Build with: g++ -std=c++11 -O2 -pthread verify.cpp -o verify
+
+#include <cstdlib>
+#include <cstring>
+#include "graphgen.hpp"
+
+int main(int argc, char** argv) {
+    bool directed = false;
+    int64_t base = 0;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--directed"))
+            directed = true;
+        else if (!strcmp(argv[i], "--base") && i + 1 < argc)
+            base = std::atoll(argv[++i]);
+        else
+            args.push_back(argv[i]);
+    }
+    if (args.empty() || args.size() > 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [--directed] [--base B] <file> [properties]" << std::endl;
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        unsigned properties = verifier::parse_properties(args.size() > 1 ? args[1] : "");
+        size_t vertices_no;
+        std::vector<uint64_t> keys;
+        {
+            utils::MappedFile file(args[0]);
+            // Undirected edges are stored with tail >= head
+            keys = utils::parse_edges<uint64_t>(
+                file.data(), file.size(), base, vertices_no,
+                [directed](vertex_t tail, vertex_t head, const char*, std::vector<uint64_t>& out) {
+                    if (!directed && tail < head)
+                        std::swap(tail, head);
+                    out.push_back(verifier::pack(tail, head));
+                }
+            );
+        }
+        verifier::check(vertices_no, keys, directed, properties);
+    } catch (std::exception& e) {
+        std::cout << args[0] << ": " << e.what() << std::endl;
+        return 1;
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << args[0] << ": OK ("
+              << std::chrono::duration<double>(end - start).count() << "s)" << std::endl;
+    return 0;
+}